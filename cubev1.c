@@ -9,13 +9,34 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 #define PI 3.14159265358979323846
 #define MAX_WIDTH 400
 #define MAX_HEIGHT 300
+#define NEAR_W 0.5
+#define FAR_W 100.0
+#define GUARD_BAND 4.0
+#define DEPTH_FRINGE (-1e9 + 1.0)
 
 typedef struct { double x, y, z; } Vec3;
+typedef struct { double m[4][4]; } Mat4;
+
+/* Float counterparts for the hot paths; the double Vec3/Mat4 helpers stay as
+ * the scalar reference. Mat4f is column-major so a column loads as one SSE
+ * register. */
+typedef struct { _Alignas(16) float x; float y, z, w; } Vec4f;
+typedef struct { _Alignas(32) float c[4][4]; } Mat4f;
 typedef struct { uint8_t r, g, b; } Color;
+_Static_assert(sizeof(Color) == 3, "Color planes are treated as packed RGB bytes");
+
+typedef struct { double x, y, z, w; double l, k, u, v; } ClipVert;    /* l: brightness, k: its key-light share */
 
 typedef struct {
     int width, height;
@@ -31,6 +52,29 @@ static double time_global = 0;
 static double rot_x = 0.7, rot_y = 0.9, rot_z = 0.3;
 static double zoom = 0.6;
 
+enum { RASTER_BBOX, RASTER_SPAN };
+
+enum {
+    CLIP_NEAR = 1 << 0, CLIP_FAR = 1 << 1,
+    CLIP_LEFT = 1 << 2, CLIP_RIGHT = 1 << 3, CLIP_TOP = 1 << 4, CLIP_BOTTOM = 1 << 5,
+    CLIP_GB_LEFT = 1 << 6, CLIP_GB_RIGHT = 1 << 7, CLIP_GB_TOP = 1 << 8, CLIP_GB_BOTTOM = 1 << 9,
+    CLIP_REJECT = CLIP_NEAR | CLIP_FAR | CLIP_LEFT | CLIP_RIGHT | CLIP_TOP | CLIP_BOTTOM,
+    CLIP_MUST = CLIP_NEAR | CLIP_FAR | CLIP_GB_LEFT | CLIP_GB_RIGHT | CLIP_GB_TOP | CLIP_GB_BOTTOM
+};
+static int raster_mode = RASTER_BBOX;
+
+enum { AA_NONE, AA_EDGE };
+static int aa_mode = AA_NONE;
+static int draw_outline = 1;
+
+enum { SHADE_FLAT, SHADE_GOURAUD };
+static int shade_mode = SHADE_FLAT;
+
+static int ssaa = 1;
+static Buffer ss_buf;
+static uint16_t *ss_acc;
+static double *ss_dmax;
+
 static const Vec3 CUBE_VERTS[8] = {
     {-1,-1,-1}, { 1,-1,-1}, { 1, 1,-1}, {-1, 1,-1},
     {-1,-1, 1}, { 1,-1, 1}, { 1, 1, 1}, {-1, 1, 1}
@@ -41,6 +85,104 @@ static const int CUBE_FACES[6][4] = {
     {1,5,6,2}, {3,2,6,7}, {4,5,1,0}
 };
 
+typedef struct { int v0, v1, f0, f1; } Edge;
+
+/* Indexed triangle mesh. Positions and vertex normals are SoA for the batch
+ * kernels; colours are per triangle. */
+typedef struct {
+    int num_verts, num_tris;
+    float *px, *py, *pz;
+    float *nx, *ny, *nz;
+    int *idx;
+    Color *colors;
+    Edge *edges;
+    int num_edges;
+    Vec3 center;
+    double radius;
+    void *map;              /* non-NULL when the arrays live in a mapped cache */
+    size_t map_size;        /* 0 when another mesh owns the mapping */
+    float *uv;              /* optional: u, v per triangle corner */
+    uint8_t *tex;           /* texture slot per triangle, with uv */
+} Mesh;
+
+static Mesh scene_mesh;
+
+/* Square power-of-two image with its mip chain; level l is size >> l texels
+ * on a side, stored in Morton order. */
+#define TEX_MAX_SIZE 512
+#define TEX_MAX_LEVELS 10
+#define MAX_TEXTURES 6
+typedef struct {
+    int size, levels;
+    Color *level[TEX_MAX_LEVELS];
+} Texture;
+
+static Texture textures[MAX_TEXTURES];
+static int num_textures;
+static int texture_enabled = 1;
+
+/* Per-instance placement in SoA form: world-space centre, uniform scale and
+ * tint, plus per-frame view-space centre, bound radius and cull result. */
+typedef struct {
+    int count;
+    float *x, *y, *z, *scale;
+    float *y0;              /* rest height when animated */
+    float *vx, *vy, *vz, *vr;
+    float *alpha;           /* below 1: translucent while OIT is on */
+    uint8_t *visible;
+    int *list;              /* per-frame visible instance indices */
+    Color *tint;
+    int moving;
+} Instances;
+
+typedef struct {
+    float lo[3], hi[3];
+    int first, count;       /* leaf: item range; inner: count 0, first = right child */
+} BvhNode;
+
+typedef struct {
+    BvhNode *nodes;
+    int num_nodes;
+    int *items;
+} Bvh;
+
+enum { CULL_LINEAR, CULL_BVH };
+static int cull_mode = CULL_BVH;
+
+static Instances scene_instances;
+static Bvh scene_bvh;
+static double view_dist = 5.0;
+
+/* Voxel volume: occupancy bitset plus a palette index per voxel, meshed per
+ * VOXEL_CHUNK^3 chunk. Chunk centres are SoA for the sphere cull. */
+typedef struct {
+    int n, nc;              /* voxels and chunks per side */
+    uint32_t *occ;          /* bit x % 32 of word (z * n + y) * nc + x / 32 */
+    uint8_t *mat;           /* palette index, 0 = empty */
+    Mesh *chunks;
+    uint8_t *dirty;
+    float *cx, *cy, *cz;    /* chunk centres in grid space */
+    float *vx, *vy, *vz, *vr;
+    uint8_t *visible;
+    int *list;              /* per-frame visible chunks */
+    int brush[3], brush_on; /* animated brush centre in voxels */
+} VoxelGrid;
+
+static VoxelGrid scene_voxels;
+
+static struct {
+    long instances;
+    long tris;          /* submitted */
+    long tris_drawn;    /* front-facing and not trivially rejected */
+    long remeshed;      /* voxel chunks rebuilt */
+    long oit_frags;     /* translucent samples accumulated */
+    long oit_samples;   /* distinct samples they covered */
+    long particles;     /* samples lit by sparks */
+    long sdf_rays;      /* samples raymarched */
+    long sdf_steps;     /* field evaluations along them */
+    double post_ms[3];  /* post-processing cost per pass, POST_* order */
+} frame_stats;
+
 static const Color FACE_COLORS[6] = {
     {255,0,128},
     {0,128,255},
@@ -83,33 +225,203 @@ static inline Vec3 normalize(Vec3 v) {
     return len > 1e-8 ? scale(v, 1.0/len) : v3(0,0,0);
 }
 
-static inline void rot_x_apply(Vec3 *v, double a) {
-    double c = cos(a), s = sin(a);
-    double y = v->y * c - v->z * s;
-    double z = v->y * s + v->z * c;
-    v->y = y; v->z = z;
+static inline Mat4 mat4_identity(void) {
+    Mat4 m = {{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1}}};
+    return m;
+}
+
+static Mat4 mat4_mul(Mat4 a, Mat4 b) {
+    Mat4 r;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] +
+                        a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+    return r;
+}
+
+static inline Mat4 mat4_translate(double x, double y, double z) {
+    Mat4 m = mat4_identity();
+    m.m[0][3] = x; m.m[1][3] = y; m.m[2][3] = z;
+    return m;
+}
+
+/* Rz * Ry * Rx: rotate about x first, then y, then z. Six trig calls per
+ * object per frame instead of six per vertex. */
+static Mat4 mat4_euler(double ax, double ay, double az) {
+    double cx = cos(ax), sx = sin(ax);
+    double cy = cos(ay), sy = sin(ay);
+    double cz = cos(az), sz = sin(az);
+    Mat4 m = {{
+        {cz*cy, cz*sy*sx - sz*cx, cz*sy*cx + sz*sx, 0},
+        {sz*cy, sz*sy*sx + cz*cx, sz*sy*cx - cz*sx, 0},
+        {-sy,   cy*sx,            cy*cx,            0},
+        {0, 0, 0, 1}
+    }};
+    return m;
+}
+
+static inline Vec3 mat4_point(const Mat4 *m, Vec3 p) {
+    return v3(
+        m->m[0][0] * p.x + m->m[0][1] * p.y + m->m[0][2] * p.z + m->m[0][3],
+        m->m[1][0] * p.x + m->m[1][1] * p.y + m->m[1][2] * p.z + m->m[1][3],
+        m->m[2][0] * p.x + m->m[2][1] * p.y + m->m[2][2] * p.z + m->m[2][3]
+    );
+}
+
+static void *alloc_aligned(size_t bytes) {
+    return aligned_alloc(32, (bytes + 31) & ~(size_t)31);
+}
+
+static inline Vec4f v4f(float x, float y, float z, float w) {
+    return (Vec4f){x, y, z, w};
+}
+
+static Mat4f mat4f_from(const Mat4 *m) {
+    Mat4f r;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            r.c[j][i] = (float)m->m[i][j];
+    return r;
+}
+
+static inline Vec4f mat4f_apply(const Mat4f *m, Vec4f p) {
+#if defined(__SSE__)
+    __m128 r = _mm_mul_ps(_mm_load_ps(m->c[0]), _mm_set1_ps(p.x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m->c[1]), _mm_set1_ps(p.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m->c[2]), _mm_set1_ps(p.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m->c[3]), _mm_set1_ps(p.w)));
+    Vec4f out;
+    _mm_store_ps(&out.x, r);
+    return out;
+#else
+    Vec4f out;
+    float *o = &out.x;
+    for (int i = 0; i < 4; i++)
+        o[i] = m->c[0][i] * p.x + m->c[1][i] * p.y + m->c[2][i] * p.z + m->c[3][i] * p.w;
+    return out;
+#endif
+}
+
+static inline float dot3f(Vec4f a, Vec4f b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline Vec4f cross3f(Vec4f a, Vec4f b) {
+#if defined(__SSE__)
+    __m128 va = _mm_load_ps(&a.x), vb = _mm_load_ps(&b.x);
+    __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(va, b_yzx), _mm_mul_ps(a_yzx, vb));
+    Vec4f out;
+    _mm_store_ps(&out.x, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+    return out;
+#else
+    return v4f(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x, 0);
+#endif
+}
+
+static inline Vec4f normalize3f(Vec4f a) {
+    float len2 = dot3f(a, a);
+    if (len2 <= 1e-16f) return v4f(0, 0, 0, a.w);
+    float inv = 1.0f / sqrtf(len2);
+    return v4f(a.x * inv, a.y * inv, a.z * inv, a.w);
 }
 
-static inline void rot_y_apply(Vec3 *v, double a) {
-    double c = cos(a), s = sin(a);
-    double x = v->x * c + v->z * s;
-    double z = -v->x * s + v->z * c;
-    v->x = x; v->z = z;
+/* SoA batch kernels: eight lanes per AVX iteration, scalar tail. */
+static void soa_transform_points(const Mat4f *m, const float *x, const float *y, const float *z,
+                                 float *ox, float *oy, float *oz, int n) {
+    int i = 0;
+#if defined(__AVX__)
+    __m256 m00 = _mm256_set1_ps(m->c[0][0]), m01 = _mm256_set1_ps(m->c[1][0]);
+    __m256 m02 = _mm256_set1_ps(m->c[2][0]), m03 = _mm256_set1_ps(m->c[3][0]);
+    __m256 m10 = _mm256_set1_ps(m->c[0][1]), m11 = _mm256_set1_ps(m->c[1][1]);
+    __m256 m12 = _mm256_set1_ps(m->c[2][1]), m13 = _mm256_set1_ps(m->c[3][1]);
+    __m256 m20 = _mm256_set1_ps(m->c[0][2]), m21 = _mm256_set1_ps(m->c[1][2]);
+    __m256 m22 = _mm256_set1_ps(m->c[2][2]), m23 = _mm256_set1_ps(m->c[3][2]);
+    for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, vx), _mm256_mul_ps(m01, vy)),
+                                  _mm256_add_ps(_mm256_mul_ps(m02, vz), m03));
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, vx), _mm256_mul_ps(m11, vy)),
+                                  _mm256_add_ps(_mm256_mul_ps(m12, vz), m13));
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, vx), _mm256_mul_ps(m21, vy)),
+                                  _mm256_add_ps(_mm256_mul_ps(m22, vz), m23));
+        _mm256_storeu_ps(ox + i, rx);
+        _mm256_storeu_ps(oy + i, ry);
+        _mm256_storeu_ps(oz + i, rz);
+    }
+#endif
+    for (; i < n; i++) {
+        float px = x[i], py = y[i], pz = z[i];
+        ox[i] = m->c[0][0] * px + m->c[1][0] * py + m->c[2][0] * pz + m->c[3][0];
+        oy[i] = m->c[0][1] * px + m->c[1][1] * py + m->c[2][1] * pz + m->c[3][1];
+        oz[i] = m->c[0][2] * px + m->c[1][2] * py + m->c[2][2] * pz + m->c[3][2];
+    }
 }
 
-static inline void rot_z_apply(Vec3 *v, double a) {
-    double c = cos(a), s = sin(a);
-    double x = v->x * c - v->y * s;
-    double y = v->x * s + v->y * c;
-    v->x = x; v->y = y;
+static void soa_normalize(float *x, float *y, float *z, int n) {
+    int i = 0;
+#if defined(__AVX__)
+    const __m256 eps = _mm256_set1_ps(1e-16f);
+    for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)),
+                                    _mm256_mul_ps(vz, vz));
+        __m256 ok = _mm256_cmp_ps(len2, eps, _CMP_GT_OQ);
+        __m256 inv = _mm256_and_ps(ok, _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len2)));
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(vx, inv));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vy, inv));
+        _mm256_storeu_ps(z + i, _mm256_mul_ps(vz, inv));
+    }
+#endif
+    for (; i < n; i++) {
+        float len2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+        float inv = len2 > 1e-16f ? 1.0f / sqrtf(len2) : 0.0f;
+        x[i] *= inv; y[i] *= inv; z[i] *= inv;
+    }
 }
 
 static inline Color rgb(uint8_t r, uint8_t g, uint8_t b) {
     return (Color){r, g, b};
 }
 
+/* Shading space. Colours are stored sRGB-encoded either way; in linear
+ * mode shade() and blends decode through a 256-entry table, work in linear
+ * float and encode through a 4096-entry one, so the per-sample cost stays a
+ * handful of loads. */
+enum { LIGHT_SRGB, LIGHT_LINEAR };
+static int light_space = LIGHT_SRGB;
+
+#define LINEAR_LUT_SIZE 4096
+static float srgb_to_linear[256];
+static uint8_t linear_to_srgb[LINEAR_LUT_SIZE];
+
+static void light_space_set(int mode) {
+    light_space = mode;
+    if (mode != LIGHT_LINEAR || linear_to_srgb[LINEAR_LUT_SIZE - 1]) return;
+    for (int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        srgb_to_linear[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+    for (int i = 0; i < LINEAR_LUT_SIZE; i++) {
+        double l = (double)i / (LINEAR_LUT_SIZE - 1);
+        double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+        linear_to_srgb[i] = (uint8_t)(c * 255.0 + 0.5);
+    }
+}
+
+/* Linear value in [0, 1] to an sRGB byte. */
+static inline uint8_t encode_srgb(float l) {
+    return linear_to_srgb[(int)(l * (LINEAR_LUT_SIZE - 1) + 0.5f)];
+}
+
 static inline Color shade(Color c, double brightness) {
     brightness = brightness < 0 ? 0 : (brightness > 1 ? 1 : brightness);
+    if (light_space == LIGHT_LINEAR) {
+        float b = (float)brightness;
+        return rgb(encode_srgb(srgb_to_linear[c.r] * b), encode_srgb(srgb_to_linear[c.g] * b),
+                   encode_srgb(srgb_to_linear[c.b] * b));
+    }
     return rgb(
         (uint8_t)(c.r * brightness),
         (uint8_t)(c.g * brightness),
@@ -127,6 +439,13 @@ static void buf_init(int w, int h) {
     buf.bot_depth = malloc(sz * sizeof(double));
 }
 
+static void buf_free(void) {
+    free(buf.top_color);
+    free(buf.bot_color);
+    free(buf.top_depth);
+    free(buf.bot_depth);
+}
+
 static void buf_clear(void) {
     size_t sz = buf.width * buf.height;
     Color black = rgb(0,0,0);
@@ -155,7 +474,56 @@ static inline void put_pixel(int x, int y, int is_top, Color col, double depth)
     }
 }
 
+/* ASCII output: each cell is one byte from a luminance ramp, with no SGR
+ * escapes; only the cursor-home prefix remains, so a frame costs
+ * 3 + height * (width + 1) bytes against tens per cell for truecolor. The
+ * two samples of a cell are averaged, an empty sample counting as black, and
+ * any cell with a drawn sample gets at least the ramp's first mark so the
+ * silhouette survives dark faces. Glyph coverage reads much darker than the
+ * same fraction of lit pixels, so the ramp is indexed by the square root of
+ * luminance, spreading the dim shaded faces over more than one mark. */
+enum { OUTPUT_COLOR, OUTPUT_ASCII };
+static int output_mode = OUTPUT_COLOR;
+
+#define ASCII_RAMP " .:-=+*#%@"
+#define ASCII_RAMP_LEN ((int)sizeof(ASCII_RAMP) - 1)
+
+static char ascii_lut[511];     /* sum of two sample luminances to a ramp byte */
+static char ascii_frame[3 + MAX_HEIGHT * (MAX_WIDTH + 1)];
+
+/* Rec. 709 weights on the stored bytes, scaled to sum to 256. */
+static inline int luma(Color c) {
+    return (54 * c.r + 183 * c.g + 19 * c.b + 128) >> 8;
+}
+
+/* Encodes the frame into ascii_frame and returns its length. */
+static size_t ascii_encode(void) {
+    if (!ascii_lut[0])
+        for (int i = 0; i < 511; i++)
+            ascii_lut[i] = ASCII_RAMP[1 + (int)(sqrt(i / 510.0) * (ASCII_RAMP_LEN - 1.001))];
+    char *o = ascii_frame;
+    memcpy(o, "\033[H", 3);
+    o += 3;
+    for (int y = 0; y < buf.height; y++) {
+        const Color *tc = buf.top_color + y * buf.width, *bc = buf.bot_color + y * buf.width;
+        const double *td = buf.top_depth + y * buf.width, *bd = buf.bot_depth + y * buf.width;
+        for (int x = 0; x < buf.width; x++) {
+            int top_set = td[x] > -1e9, bot_set = bd[x] > -1e9;
+            int sum = (top_set ? luma(tc[x]) : 0) + (bot_set ? luma(bc[x]) : 0);
+            o[x] = top_set | bot_set ? ascii_lut[sum] : ' ';
+        }
+        o += buf.width;
+        *o++ = '\n';
+    }
+    return (size_t)(o - ascii_frame);
+}
+
 static void buf_render(void) {
+    if (output_mode == OUTPUT_ASCII) {
+        fwrite(ascii_frame, 1, ascii_encode(), stdout);
+        fflush(stdout);
+        return;
+    }
     printf("\033[H\033[0m");
     Color last_fg = (Color){255,255,255};
     Color last_bg = (Color){255,255,255};
@@ -218,7 +586,8 @@ static void term_init(void) {
 
 static void term_cleanup(void) {
     tcsetattr(0, TCSANOW, &orig_term);
-    printf("\033[?25h\033[0m\033[2J\033[H\033[?1049l");
+    printf(output_mode == OUTPUT_ASCII ? "\033[?25h\033[2J\033[H\033[?1049l"
+                                       : "\033[?25h\033[0m\033[2J\033[H\033[?1049l");
 }
 
 static void get_term_size(int *w, int *h) {
@@ -232,19 +601,100 @@ static void get_term_size(int *w, int *h) {
     }
 }
 
-static inline int project(Vec3 p, double *x, double *y, double *z) {
-    if (p.z >= -0.5 || p.z <= -100.0) return 0;
+/* Clip space: x, y are pre-divide screen offsets from the viewport centre and
+ * w = -z, so the near/far planes are w = NEAR_W / FAR_W and the viewport is
+ * |x| <= w * width/2, |y| <= w * height. z carries view depth for the
+ * depth buffer. */
+static inline double proj_scale(void) {
     double focal = 5.0;
-    double factor = -focal / p.z;
     double pixel_h = buf.height * 2.0;
     double min_dim = buf.width < pixel_h ? buf.width : pixel_h;
-    double scale = min_dim * 0.38 * zoom;
-    *x = p.x * factor * scale + buf.width * 0.5;
-    *y = -p.y * factor * scale + pixel_h * 0.5;
-    *z = p.z;
-    return 1;
+    return focal * min_dim * 0.38 * zoom;
+}
+
+static inline ClipVert to_clip(Vec3 p) {
+    double s = proj_scale();
+    return (ClipVert){p.x * s, -p.y * s, p.z, -p.z, 0, 0, 0, 0};
+}
+
+static inline Vec3 clip_to_screen(ClipVert c) {
+    double inv = 1.0 / c.w;
+    return v3(c.x * inv + buf.width * 0.5, c.y * inv + buf.height, c.z);
+}
+
+/* Batch to_clip() + clip_to_screen() for view-space SoA input. Only lanes
+ * with -z >= NEAR_W are meaningful; the caller clips the rest. */
+static void soa_project(const float *x, const float *y, const float *z,
+                        float *sx, float *sy, int n) {
+    float s = (float)proj_scale();
+    float cx = (float)(buf.width * 0.5), cy = (float)buf.height;
+    int i = 0;
+#if defined(__AVX__)
+    const __m256 vs = _mm256_set1_ps(s), vnegs = _mm256_set1_ps(-s);
+    const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy);
+    const __m256 near_w = _mm256_set1_ps((float)NEAR_W);
+    for (; i + 8 <= n; i += 8) {
+        __m256 w = _mm256_max_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(z + i)), near_w);
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), w);
+        _mm256_storeu_ps(sx + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i), vs), inv), vcx));
+        _mm256_storeu_ps(sy + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(y + i), vnegs), inv), vcy));
+    }
+#endif
+    for (; i < n; i++) {
+        float w = fmaxf(-z[i], (float)NEAR_W);
+        sx[i] = x[i] * s / w + cx;
+        sy[i] = -y[i] * s / w + cy;
+    }
+}
+
+static inline ClipVert clip_lerp(ClipVert a, ClipVert b, double t) {
+    return (ClipVert){
+        a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+        a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t,
+        a.l + (b.l - a.l) * t, a.k + (b.k - a.k) * t,
+        a.u + (b.u - a.u) * t, a.v + (b.v - a.v) * t
+    };
+}
+
+/* Signed distance to clip plane, positive inside. The guard-band planes sit
+ * GUARD_BAND viewport half-extents out from the centre. */
+static inline double plane_dist(ClipVert c, int plane) {
+    double hx = buf.width * 0.5, hy = (double)buf.height;
+    switch (plane) {
+    case CLIP_NEAR:      return c.w - NEAR_W;
+    case CLIP_FAR:       return FAR_W - c.w;
+    case CLIP_LEFT:      return c.x + hx * c.w;
+    case CLIP_RIGHT:     return hx * c.w - c.x;
+    case CLIP_TOP:       return c.y + hy * c.w;
+    case CLIP_BOTTOM:    return hy * c.w - c.y;
+    case CLIP_GB_LEFT:   return c.x + GUARD_BAND * hx * c.w;
+    case CLIP_GB_RIGHT:  return GUARD_BAND * hx * c.w - c.x;
+    case CLIP_GB_TOP:    return c.y + GUARD_BAND * hy * c.w;
+    default:             return GUARD_BAND * hy * c.w - c.y;
+    }
+}
+
+static inline int outcode(ClipVert c) {
+    int code = 0;
+    for (int plane = 1; plane <= CLIP_GB_BOTTOM; plane <<= 1)
+        if (plane_dist(c, plane) < 0) code |= plane;
+    return code;
+}
+
+/* Sutherland-Hodgman against a single plane. */
+static int clip_poly(const ClipVert *in, int n, ClipVert *out, int plane) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        ClipVert a = in[i], b = in[(i + 1) % n];
+        double da = plane_dist(a, plane), db = plane_dist(b, plane);
+        if (da >= 0) out[m++] = a;
+        if ((da >= 0) != (db >= 0)) out[m++] = clip_lerp(a, b, da / (da - db));
+    }
+    return m;
 }
 
+/* Scalar reference: rebuilds the lights for every call. The renderer shades
+ * through the per-frame light block below; this stays for the benchmark. */
 static double calc_light(Vec3 normal) {
     Vec3 light1 = normalize(v3(
         sin(time_global * 0.7) * 10,
@@ -261,10 +711,222 @@ static double calc_light(Vec3 normal) {
     return fmin(ambient + diff1 + diff2 + spec, 1.0);
 }
 
+/* ---- lighting ----
+ * The light block is rebuilt once per frame; faces are then shaded in SoA
+ * batches against it. Directions, halfway vectors and point positions are
+ * in view space. Specular uses an integer power, evaluated by squaring. */
+#define MAX_LIGHTS 8
+
+static struct {
+    float ambient;
+    int spec_power;
+    float spec_cutoff;      /* below this the specular term is under 1e-30 */
+    int num_dir, num_point;
+    float dir[MAX_LIGHTS][3], half[MAX_LIGHTS][3];
+    float dir_diffuse[MAX_LIGHTS], dir_spec[MAX_LIGHTS];
+    float point[MAX_LIGHTS][3];
+    float point_diffuse, point_spec, point_inv_range2;
+    float view[3];
+} lights;
+
+static int num_point_lights = 0;
+
+/* The two directional lights of calc_light(), plus num_point_lights lights
+ * orbiting the middle of the scene. */
+static void lights_update(void) {
+    static const float diffuse[2] = {0.8f, 0.15f}, spec[2] = {0.55f, 0.0f};
+    Vec3 view_dir = v3(0, 0, -1);
+    Vec3 dir[2] = {
+        normalize(v3(sin(time_global * 0.7) * 10, cos(time_global * 0.4) * 8 + 10, -5)),
+        normalize(v3(-6, -4, -8))
+    };
+    lights.ambient = 0.15f;
+    lights.spec_power = 100;
+    lights.spec_cutoff = (float)exp(log(1e-30) / lights.spec_power);
+    lights.num_dir = 2;
+    for (int k = 0; k < 2; k++) {
+        Vec3 h = normalize(add(dir[k], view_dir));
+        lights.dir[k][0] = (float)dir[k].x; lights.dir[k][1] = (float)dir[k].y; lights.dir[k][2] = (float)dir[k].z;
+        lights.half[k][0] = (float)h.x; lights.half[k][1] = (float)h.y; lights.half[k][2] = (float)h.z;
+        lights.dir_diffuse[k] = diffuse[k];
+        lights.dir_spec[k] = spec[k];
+    }
+    lights.view[0] = (float)view_dir.x; lights.view[1] = (float)view_dir.y; lights.view[2] = (float)view_dir.z;
+
+    double r = view_dist * 0.5;
+    lights.num_point = num_point_lights;
+    lights.point_diffuse = 0.6f;
+    lights.point_spec = 0.35f;
+    lights.point_inv_range2 = (float)(1.0 / (r * r));
+    for (int k = 0; k < num_point_lights; k++) {
+        double a = time_global * 0.9 + 2.0 * PI * k / num_point_lights;
+        lights.point[k][0] = (float)(cos(a) * r * 1.2);
+        lights.point[k][1] = (float)(sin(a * 0.7 + k) * r * 0.5);
+        lights.point[k][2] = (float)(-view_dist + sin(a) * r * 1.2);
+    }
+}
+
+/* x^n by squaring for the specular term. Inputs under spec_cutoff go to
+ * zero up front, so no intermediate power turns denormal. */
+static inline float powi_f(float x, int n) {
+    if (x < lights.spec_cutoff) return 0.0f;
+    float r = 1.0f;
+    for (;;) {
+        if (n & 1) r *= x;
+        if (!(n >>= 1)) return r;
+        x *= x;
+    }
+}
+
+/* One face: unit normal n, centre p. key, if given, receives the share of
+ * the result that comes from the first (shadow-casting) light. */
+static float light_face(float nx, float ny, float nz, float px, float py, float pz, float *key) {
+    float acc = lights.ambient;
+    for (int k = 0; k < lights.num_dir; k++) {
+        const float *l = lights.dir[k], *h = lights.half[k];
+        acc += fmaxf(nx * l[0] + ny * l[1] + nz * l[2], 0.0f) * lights.dir_diffuse[k];
+        if (lights.dir_spec[k] > 0)
+            acc += powi_f(fmaxf(nx * h[0] + ny * h[1] + nz * h[2], 0.0f), lights.spec_power) * lights.dir_spec[k];
+        if (k == 0 && key) *key = acc - lights.ambient;
+    }
+    for (int k = 0; k < lights.num_point; k++) {
+        float lx = lights.point[k][0] - px, ly = lights.point[k][1] - py, lz = lights.point[k][2] - pz;
+        float d2 = fmaxf(lx * lx + ly * ly + lz * lz, 1e-12f), inv = 1.0f / sqrtf(d2);
+        float att = 1.0f / (1.0f + d2 * lights.point_inv_range2);
+        lx *= inv; ly *= inv; lz *= inv;
+        float hx = lx + lights.view[0], hy = ly + lights.view[1], hz = lz + lights.view[2];
+        float hinv = 1.0f / sqrtf(fmaxf(hx * hx + hy * hy + hz * hz, 1e-12f));
+        float diff = fmaxf(nx * lx + ny * ly + nz * lz, 0.0f) * lights.point_diffuse;
+        float spec = powi_f(fmaxf((nx * hx + ny * hy + nz * hz) * hinv, 0.0f), lights.spec_power) * lights.point_spec;
+        acc += (diff + spec) * att;
+    }
+    return fminf(acc, 1.0f);
+}
+
+#if defined(__AVX__)
+static inline __m256 powi_ps(__m256 x, int n) {
+    x = _mm256_and_ps(x, _mm256_cmp_ps(x, _mm256_set1_ps(lights.spec_cutoff), _CMP_GE_OQ));
+    __m256 r = _mm256_set1_ps(1.0f);
+    for (;;) {
+        if (n & 1) r = _mm256_mul_ps(r, x);
+        if (!(n >>= 1)) return r;
+        x = _mm256_mul_ps(x, x);
+    }
+}
+
+/* rsqrt estimate refined by one Newton step: about 22 bits. */
+static inline __m256 rsqrt_ps(__m256 x) {
+    __m256 y = _mm256_rsqrt_ps(x);
+    __m256 yyx = _mm256_mul_ps(_mm256_mul_ps(y, y), x);
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y), _mm256_sub_ps(_mm256_set1_ps(3.0f), yyx));
+}
+
+static inline __m256 dot_ps(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+#endif
+
+/* light_face() over SoA normals and centres, eight faces per AVX iteration.
+ * key may be NULL. */
+static void soa_light(const float *nx, const float *ny, const float *nz,
+                      const float *px, const float *py, const float *pz, float *out, float *key, int n) {
+    int i = 0;
+#if defined(__AVX__)
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 eps = _mm256_set1_ps(1e-12f);
+    const __m256 vx = _mm256_set1_ps(lights.view[0]), vy = _mm256_set1_ps(lights.view[1]);
+    const __m256 vz = _mm256_set1_ps(lights.view[2]);
+    const __m256 inv_r2 = _mm256_set1_ps(lights.point_inv_range2);
+    const __m256 pdiff = _mm256_set1_ps(lights.point_diffuse), pspec = _mm256_set1_ps(lights.point_spec);
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(nx + i), y = _mm256_loadu_ps(ny + i), z = _mm256_loadu_ps(nz + i);
+        __m256 acc = _mm256_set1_ps(lights.ambient);
+        for (int k = 0; k < lights.num_dir; k++) {
+            const float *l = lights.dir[k], *h = lights.half[k];
+            __m256 d = dot_ps(x, y, z, _mm256_set1_ps(l[0]), _mm256_set1_ps(l[1]), _mm256_set1_ps(l[2]));
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_max_ps(d, zero), _mm256_set1_ps(lights.dir_diffuse[k])));
+            if (lights.dir_spec[k] > 0) {
+                __m256 s = dot_ps(x, y, z, _mm256_set1_ps(h[0]), _mm256_set1_ps(h[1]), _mm256_set1_ps(h[2]));
+                s = powi_ps(_mm256_max_ps(s, zero), lights.spec_power);
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(s, _mm256_set1_ps(lights.dir_spec[k])));
+            }
+            if (k == 0 && key) _mm256_storeu_ps(key + i, _mm256_sub_ps(acc, _mm256_set1_ps(lights.ambient)));
+        }
+        if (lights.num_point) {
+            __m256 cx = _mm256_loadu_ps(px + i), cy = _mm256_loadu_ps(py + i), cz = _mm256_loadu_ps(pz + i);
+            for (int k = 0; k < lights.num_point; k++) {
+                __m256 lx = _mm256_sub_ps(_mm256_set1_ps(lights.point[k][0]), cx);
+                __m256 ly = _mm256_sub_ps(_mm256_set1_ps(lights.point[k][1]), cy);
+                __m256 lz = _mm256_sub_ps(_mm256_set1_ps(lights.point[k][2]), cz);
+                __m256 d2 = _mm256_max_ps(dot_ps(lx, ly, lz, lx, ly, lz), eps);
+                __m256 inv = rsqrt_ps(d2);
+                __m256 att = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_mul_ps(d2, inv_r2)));
+                lx = _mm256_mul_ps(lx, inv); ly = _mm256_mul_ps(ly, inv); lz = _mm256_mul_ps(lz, inv);
+                __m256 hx = _mm256_add_ps(lx, vx), hy = _mm256_add_ps(ly, vy), hz = _mm256_add_ps(lz, vz);
+                __m256 hinv = rsqrt_ps(_mm256_max_ps(dot_ps(hx, hy, hz, hx, hy, hz), eps));
+                __m256 diff = _mm256_mul_ps(_mm256_max_ps(dot_ps(x, y, z, lx, ly, lz), zero), pdiff);
+                __m256 s = _mm256_mul_ps(dot_ps(x, y, z, hx, hy, hz), hinv);
+                s = _mm256_mul_ps(powi_ps(_mm256_max_ps(s, zero), lights.spec_power), pspec);
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_add_ps(diff, s), att));
+            }
+        }
+        _mm256_storeu_ps(out + i, _mm256_min_ps(acc, one));
+    }
+#endif
+    for (; i < n; i++) out[i] = light_face(nx[i], ny[i], nz[i], px[i], py[i], pz[i], key ? key + i : NULL);
+}
+
+/* Shadow map for the first directional light: an orthographic depth image
+ * over the scene's bounding sphere, set up in view space like the light
+ * block. Depth grows toward the light, as view depth grows toward the
+ * eye. Only faces turned away from the light are drawn into it, so a lit
+ * surface is compared against the far side of its caster, never against
+ * itself, and a small constant bias is enough. */
+#define SHADOW_DEFAULT 256
+#define SHADOW_MAX 2048
+
+static struct {
+    int size;               /* texels per side */
+    float *depth;           /* size * size, row-major */
+    Mat4 from_view;         /* view space -> (texel x, texel y, depth) */
+    double bias;
+} shadow = {SHADOW_DEFAULT, NULL, {{{0}}}, 0};
+static int shadow_enabled = 0;
+
+/* Fraction of the key light reaching light-space point (x, y, z): four
+ * depth compares weighted bilinearly (PCF). Outside the map is lit. */
+static inline double shadow_pcf(double x, double y, double z) {
+    int s = shadow.size;
+    x -= 0.5;
+    y -= 0.5;
+    double fx = floor(x), fy = floor(y);
+    int x0 = (int)fx, y0 = (int)fy;
+    fx = x - fx;
+    fy = y - fy;
+    float zb = (float)(z + shadow.bias);
+    double lit[4];
+    for (int k = 0; k < 4; k++) {
+        int tx = x0 + (k & 1), ty = y0 + (k >> 1);
+        lit[k] = tx < 0 || ty < 0 || tx >= s || ty >= s || zb >= shadow.depth[ty * s + tx];
+    }
+    return (lit[0] + (lit[1] - lit[0]) * fx) * (1 - fy) + (lit[2] + (lit[3] - lit[2]) * fx) * fy;
+}
+
 static void draw_line(Vec3 p0, Vec3 p1, Color col) {
-    double x0, y0, z0, x1, y1, z1;
-    if (!project(p0, &x0, &y0, &z0) || !project(p1, &x1, &y1, &z1)) return;
-    
+    ClipVert c0 = to_clip(p0), c1 = to_clip(p1);
+    double t0 = 0, t1 = 1;
+    for (int plane = CLIP_NEAR; plane <= CLIP_BOTTOM; plane <<= 1) {
+        double d0 = plane_dist(c0, plane), d1 = plane_dist(c1, plane);
+        if (d0 < 0 && d1 < 0) return;
+        if (d0 < 0) t0 = fmax(t0, d0 / (d0 - d1));
+        else if (d1 < 0) t1 = fmin(t1, d0 / (d0 - d1));
+    }
+    if (t0 > t1) return;
+    Vec3 s0 = clip_to_screen(clip_lerp(c0, c1, t0));
+    Vec3 s1 = clip_to_screen(clip_lerp(c0, c1, t1));
+    double x0 = s0.x, y0 = s0.y, z0 = s0.z;
+    double x1 = s1.x, y1 = s1.y, z1 = s1.z;
+
     int dx = abs((int)x1 - (int)x0);
     int dy = abs((int)y1 - (int)y0);
     int sx = x0 < x1 ? 1 : -1;
@@ -289,20 +951,252 @@ static void draw_line(Vec3 p0, Vec3 p1, Color col) {
     }
 }
 
-static void fill_tri(Vec3 v0, Vec3 v1, Vec3 v2, Color col, double brightness) {
-    double x0, y0, z0, x1, y1, z1, x2, y2, z2;
-    if (!project(v0, &x0, &y0, &z0)) return;
-    if (!project(v1, &x1, &y1, &z1)) return;
-    if (!project(v2, &x2, &y2, &z2)) return;
+static inline void sample_row(int y, Color **col, double **depth, double *bias) {
+    int row = (y / 2) * buf.width;
+    if (y % 2 == 0) {
+        *col = buf.top_color + row;
+        *depth = buf.top_depth + row;
+        *bias = 0.0;
+    } else {
+        *col = buf.bot_color + row;
+        *depth = buf.bot_depth + row;
+        *bias = 0.01;
+    }
+}
+
+static inline Color lerp_color(Color a, Color b, double t) {
+    if (light_space == LIGHT_LINEAR) {
+        float ft = (float)t;
+        const float *d = srgb_to_linear;
+        return rgb(encode_srgb(d[a.r] + (d[b.r] - d[a.r]) * ft), encode_srgb(d[a.g] + (d[b.g] - d[a.g]) * ft),
+                   encode_srgb(d[a.b] + (d[b.b] - d[a.b]) * ft));
+    }
+    return rgb(
+        (uint8_t)(a.r + (b.r - a.r) * t + 0.5),
+        (uint8_t)(a.g + (b.g - a.g) * t + 0.5),
+        (uint8_t)(a.b + (b.b - a.b) * t + 0.5)
+    );
+}
+
+static inline Color tint_color(Color c, Color tint) {
+    return rgb((uint8_t)(c.r * tint.r / 255), (uint8_t)(c.g * tint.g / 255), (uint8_t)(c.b * tint.b / 255));
+}
 
-    int min_x = (int)floor(fmin(x0, fmin(x1, x2))); if (min_x < 0) min_x = 0;
-    int max_x = (int)ceil(fmax(x0, fmax(x1, x2)));  if (max_x >= buf.width) max_x = buf.width - 1;
-    int min_y = (int)floor(fmin(y0, fmin(y1, y2))); if (min_y < 0) min_y = 0;
-    int max_y = (int)ceil(fmax(y0, fmax(y1, y2)));  if (max_y >= buf.height * 2) max_y = buf.height * 2 - 1;
+/* Morton index of texel (x, y): the bits of x and y interleaved, via a
+ * table that spreads each coordinate bit to every other position. */
+static uint32_t morton_lut[TEX_MAX_SIZE];
 
-    double area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
-    if (fabs(area) < 1e-8) return;
-    Color shaded = shade(col, brightness);
+static void texture_init_morton(void) {
+    if (morton_lut[1]) return;
+    for (uint32_t i = 0; i < TEX_MAX_SIZE; i++) {
+        uint32_t m = 0;
+        for (int b = 0; b < 10; b++) m |= ((i >> b) & 1u) << (2 * b);
+        morton_lut[i] = m;
+    }
+}
+
+static inline uint32_t tex_index(int x, int y) {
+    return morton_lut[x] | morton_lut[y] << 1;
+}
+
+/* Nearest texel of level at (u, v) in [0, 1], clamped at the border. */
+static inline Color tex_sample(const Texture *t, int level, double u, double v) {
+    int s = t->size >> level;
+    int x = (int)(u * s), y = (int)(v * s);
+    x = x < 0 ? 0 : x >= s ? s - 1 : x;
+    y = y < 0 ? 0 : y >= s ? s - 1 : y;
+    return t->level[level][tex_index(x, y)];
+}
+
+/* ---- translucency ----
+ * Weighted-blended order-independent transparency. Translucent triangles
+ * depth-test against the opaque scene but never write depth; every sample
+ * they cover adds its colour times alpha and a depth weight to an
+ * accumulation plane, and multiplies (1 - alpha) into a revealage plane.
+ * One resolve per frame lays the weighted average over the opaque colour,
+ * so draw order does not matter, nothing is sorted, and the cost is one
+ * accumulate per covered sample however the layers overlap. Each sample
+ * row records the columns it touched, so resolving and re-clearing cost
+ * follow the translucent area rather than the frame. */
+static int oit_enabled = 0;
+static double translucent_alpha = 0.5;
+
+static struct {
+    int width, rows;
+    float *accum;       /* per sample: r, g, b (times weight), weight */
+    float *reveal;      /* per sample: product of (1 - alpha) */
+    int *lo, *hi;       /* touched columns per sample row, hi < lo if none */
+} oit;
+
+static void oit_free(void) {
+    free(oit.accum);
+    free(oit.reveal);
+    free(oit.lo);
+    memset(&oit, 0, sizeof(oit));
+}
+
+/* Sizes the planes to the buffer being drawn (the SSAA one when active);
+ * they are left cleared, and oit_resolve() clears what it reads. */
+static int oit_reserve(void) {
+    if (oit.accum && oit.width == buf.width && oit.rows == buf.height * 2) return 0;
+    oit_free();
+    oit.width = buf.width;
+    oit.rows = buf.height * 2;
+    size_t n = (size_t)oit.width * (size_t)oit.rows;
+    oit.accum = alloc_aligned(n * 4 * sizeof(float));
+    oit.reveal = alloc_aligned(n * sizeof(float));
+    oit.lo = malloc((size_t)oit.rows * 2 * sizeof(int));
+    if (!oit.accum || !oit.reveal || !oit.lo) {
+        oit_free();
+        return -1;
+    }
+    oit.hi = oit.lo + oit.rows;
+    memset(oit.accum, 0, n * 4 * sizeof(float));
+    for (size_t i = 0; i < n; i++) oit.reveal[i] = 1.0f;
+    for (int y = 0; y < oit.rows; y++) { oit.lo[y] = oit.width; oit.hi[y] = -1; }
+    return 0;
+}
+
+/* Accumulates one translucent sample that passed the depth test. The weight
+ * falls with the fourth power of distance relative to the scene centre, so
+ * nearer layers dominate the average. Colour is kept in [0, 1], linear when
+ * the shading space is. */
+static inline void oit_add(int y, int x, double z, Color c, double a) {
+    double d = -z / view_dist, w = 1.0 / (1e-3 + d * d * d * d);
+    float fw = (float)(a * (w < 1e-2 ? 1e-2 : (w > 3e3 ? 3e3 : w)));
+    size_t i = (size_t)y * (size_t)oit.width + (size_t)x;
+    float *acc = oit.accum + i * 4;
+    if (light_space == LIGHT_LINEAR) {
+        acc[0] += fw * srgb_to_linear[c.r];
+        acc[1] += fw * srgb_to_linear[c.g];
+        acc[2] += fw * srgb_to_linear[c.b];
+    } else {
+        float k = fw * (1.0f / 255.0f);
+        acc[0] += k * c.r;
+        acc[1] += k * c.g;
+        acc[2] += k * c.b;
+    }
+    acc[3] += fw;
+    oit.reveal[i] *= (float)(1.0 - a);
+    if (x < oit.lo[y]) oit.lo[y] = x;
+    if (x > oit.hi[y]) oit.hi[y] = x;
+    frame_stats.oit_frags++;
+}
+
+/* colour = average * (1 - revealage) + opaque * revealage, then the planes
+ * go back to empty. Translucent light over an empty sample marks it as
+ * fringe so it is drawn. */
+static void oit_resolve(void) {
+    for (int y = 0; y < oit.rows; y++) {
+        if (oit.hi[y] < oit.lo[y]) continue;
+        Color *col; double *depth; double bias;
+        sample_row(y, &col, &depth, &bias);
+        for (int x = oit.lo[y]; x <= oit.hi[y]; x++) {
+            size_t i = (size_t)y * (size_t)oit.width + (size_t)x;
+            float *acc = oit.accum + i * 4, r = oit.reveal[i];
+            if (acc[3] <= 0) continue;
+            float k = (1.0f - r) / acc[3];
+            Color c = col[x];
+            if (light_space == LIGHT_LINEAR) {
+                const float *l = srgb_to_linear;
+                col[x] = rgb(encode_srgb(fminf(l[c.r] * r + acc[0] * k, 1.0f)),
+                             encode_srgb(fminf(l[c.g] * r + acc[1] * k, 1.0f)),
+                             encode_srgb(fminf(l[c.b] * r + acc[2] * k, 1.0f)));
+            } else {
+                col[x] = rgb((uint8_t)fminf(c.r * r + acc[0] * k * 255.0f + 0.5f, 255.0f),
+                             (uint8_t)fminf(c.g * r + acc[1] * k * 255.0f + 0.5f, 255.0f),
+                             (uint8_t)fminf(c.b * r + acc[2] * k * 255.0f + 0.5f, 255.0f));
+            }
+            if (depth[x] <= -1e9) depth[x] = DEPTH_FRINGE;
+            acc[0] = acc[1] = acc[2] = acc[3] = 0;
+            oit.reveal[i] = 1.0f;
+            frame_stats.oit_samples++;
+        }
+        oit.lo[y] = oit.width;
+        oit.hi[y] = -1;
+    }
+}
+
+/* What a triangle writes: one colour, or (Gouraud) its base colour scaled
+ * by a brightness interpolated from the vertices with the same edge
+ * functions as depth. Textured triangles scale a texel instead; u/v are
+ * interpolated as u/w, v/w and 1/w (uq, vq, q) and divided per sample,
+ * and the texel takes the instance tint when there is one. Shadowed
+ * triangles interpolate their light-space position the same way and take
+ * the key light's share back out where the shadow map occludes.
+ * Translucent (oit) triangles accumulate at alpha instead of writing. */
+typedef struct {
+    Color flat;
+    Color base;
+    double light[3];
+    int smooth;
+    const Texture *tex;
+    int level;
+    double u[3], v[3];
+    int tinted;
+    Color tint;
+    int shadow;
+    double key[3];              /* key-light share of light */
+    double q[3], uq[3], vq[3];  /* set by raster_tri */
+    double sxq[3], syq[3], szq[3];
+    int oit;
+    double alpha;
+} TriPaint;
+
+/* Colour at barycentrics (b0, b1, b2). */
+static inline Color paint_at(const TriPaint *p, double b0, double b1, double b2) {
+    if (!p->tex && !p->shadow) {
+        if (!p->smooth) return p->flat;
+        return shade(p->base, b0 * p->light[0] + b1 * p->light[1] + b2 * p->light[2]);
+    }
+    double l = b0 * p->light[0] + b1 * p->light[1] + b2 * p->light[2];
+    double q = 1.0 / (b0 * p->q[0] + b1 * p->q[1] + b2 * p->q[2]);
+    Color c = p->base;
+    if (p->tex) {
+        double u = (b0 * p->uq[0] + b1 * p->uq[1] + b2 * p->uq[2]) * q;
+        double v = (b0 * p->vq[0] + b1 * p->vq[1] + b2 * p->vq[2]) * q;
+        c = tex_sample(p->tex, p->level, u, v);
+        if (p->tinted) c = tint_color(c, p->tint);
+    }
+    if (p->shadow) {
+        double key = b0 * p->key[0] + b1 * p->key[1] + b2 * p->key[2];
+        if (key > 0) {
+            double vis = shadow_pcf((b0 * p->sxq[0] + b1 * p->sxq[1] + b2 * p->sxq[2]) * q,
+                                    (b0 * p->syq[0] + b1 * p->syq[1] + b2 * p->syq[2]) * q,
+                                    (b0 * p->szq[0] + b1 * p->szq[1] + b2 * p->szq[2]) * q);
+            l -= (1 - vis) * key;
+        }
+    }
+    return shade(c, l);
+}
+
+/* Partial-coverage write for samples just outside a triangle edge. The colour
+ * is blended over whatever is already there; the depth is left alone unless
+ * the sample was empty, so later geometry still overwrites the fringe. */
+static inline void blend_sample(Color *col, double *depth, int x, double z,
+                                double bias, Color c, double cov) {
+    if (!(z > depth[x] - bias)) return;
+    col[x] = lerp_color(col[x], c, cov);
+    if (depth[x] <= -1e9) depth[x] = DEPTH_FRINGE;
+}
+
+static void raster_bbox(Vec3 s0, Vec3 s1, Vec3 s2, double area, const TriPaint *paint) {
+    double x0 = s0.x, y0 = s0.y, z0 = s0.z;
+    double x1 = s1.x, y1 = s1.y, z1 = s1.z;
+    double x2 = s2.x, y2 = s2.y, z2 = s2.z;
+    int aa = aa_mode == AA_EDGE;
+    int pad = aa ? 1 : 0;
+
+    int min_x = (int)floor(fmin(x0, fmin(x1, x2))) - pad; if (min_x < 0) min_x = 0;
+    int max_x = (int)ceil(fmax(x0, fmax(x1, x2))) + pad;  if (max_x >= buf.width) max_x = buf.width - 1;
+    int min_y = (int)floor(fmin(y0, fmin(y1, y2))) - pad; if (min_y < 0) min_y = 0;
+    int max_y = (int)ceil(fmax(y0, fmax(y1, y2))) + pad;  if (max_y >= buf.height * 2) max_y = buf.height * 2 - 1;
+
+    /* Signed edge distance in samples is w * sign / |edge|. */
+    double sign = area > 0 ? 1.0 : -1.0;
+    double il0 = sign / hypot(x2 - x1, y2 - y1);
+    double il1 = sign / hypot(x0 - x2, y0 - y2);
+    double il2 = sign / hypot(x1 - x0, y1 - y0);
 
     for (int y = min_y; y <= max_y; y++) {
         double py = (double)y + 0.5;
@@ -323,149 +1217,4820 @@ static void fill_tri(Vec3 v0, Vec3 v1, Vec3 v2, Color col, double brightness) {
 
                 int cell_y = y / 2;
                 int is_top = (y % 2 == 0);
-                if (cell_y >= 0 && cell_y < buf.height) put_pixel(x, cell_y, is_top, shaded, z);
+                if (paint->oit) {
+                    Color *col; double *depth; double bias;
+                    sample_row(y, &col, &depth, &bias);
+                    if (z > depth[x] - bias) oit_add(y, x, z, paint_at(paint, b0, b1, b2), paint->alpha);
+                } else if (cell_y >= 0 && cell_y < buf.height)
+                    put_pixel(x, cell_y, is_top, paint_at(paint, b0, b1, b2), z);
+            } else if (aa) {
+                double d = fmin(w0 * il0, fmin(w1 * il1, w2 * il2));
+                if (d <= -0.5) continue;
+                double invA = 1.0 / area;
+                double z = (w0 * z0 + w1 * z1 + w2 * z2) * invA;
+                Color *col; double *depth; double bias;
+                sample_row(y, &col, &depth, &bias);
+                Color c = paint_at(paint, w0 * invA, w1 * invA, w2 * invA);
+                if (!paint->oit) blend_sample(col, depth, x, z, bias, c, 0.5 + d);
+                else if (z > depth[x] - bias) oit_add(y, x, z, c, paint->alpha * (0.5 + d));
             }
         }
     }
 }
 
-static void render_cube(void) {
-    Vec3 verts[8];
-    
-    double size = 1.0;
-    
-    for (int i = 0; i < 8; i++) {
-        Vec3 v = scale(CUBE_VERTS[i], size);
-        rot_x_apply(&v, rot_x);
-        rot_y_apply(&v, rot_y);
-        rot_z_apply(&v, rot_z);
-        v.z -= 5.0;
-        verts[i] = v;
-    }
-
-    typedef struct {
-        int idx;
-        double depth;
-        Vec3 center;
-        Vec3 normal;
-        double brightness;
-    } Face;
-    
-    Face faces[6];
-    int num_vis = 0;
-    
-    for (int i = 0; i < 6; i++) {
-        const int *f = CUBE_FACES[i];
-        Vec3 v0 = verts[f[0]], v1 = verts[f[1]], v2 = verts[f[2]];
-        
-        Vec3 edge1 = sub(v1, v0);
-        Vec3 edge2 = sub(v2, v0);
-        Vec3 normal = normalize(cross(edge1, edge2));
-        
-        Vec3 center = scale(add(add(add(verts[f[0]], verts[f[1]]), verts[f[2]]), verts[f[3]]), 0.25);
-        
-        Vec3 to_cam = normalize(scale(center, -1.0));
-        if (dot(normal, to_cam) > 0) {
-            double brightness = calc_light(normal);
-            
-            faces[num_vis].idx = i;
-            faces[num_vis].depth = center.z;
-            faces[num_vis].center = center;
-            faces[num_vis].normal = normal;
-            faces[num_vis].brightness = brightness;
-            num_vis++;
+/* Clip the sample-center line px to the half-plane where the edge function
+ * a + b*px has the triangle's winding sign. Returns 0 if the row misses. */
+static inline int edge_span(double a, double b, double sign, double *lo, double *hi) {
+    a *= sign; b *= sign;
+    if (b > 0) { double t = -a / b; if (t > *lo) *lo = t; }
+    else if (b < 0) { double t = -a / b; if (t < *hi) *hi = t; }
+    else if (a < 0) return 0;
+    return *lo <= *hi;
+}
+
+static void fill_span(Color *col, double *depth, int xs, int xe,
+                      double zc, double dzdx, double bias, Color shaded) {
+    int x = xs;
+#if defined(__AVX__)
+    const __m256d lane = _mm256_set_pd(3.5, 2.5, 1.5, 0.5);
+    const __m256d vdz = _mm256_set1_pd(dzdx);
+    const __m256d vzc = _mm256_set1_pd(zc);
+    const __m256d vbias = _mm256_set1_pd(bias);
+    for (; x + 3 <= xe; x += 4) {
+        __m256d px = _mm256_add_pd(_mm256_set1_pd((double)x), lane);
+        __m256d z = _mm256_add_pd(vzc, _mm256_mul_pd(vdz, px));
+        __m256d d = _mm256_loadu_pd(depth + x);
+        __m256d pass = _mm256_cmp_pd(z, _mm256_sub_pd(d, vbias), _CMP_GT_OQ);
+        int mask = _mm256_movemask_pd(pass);
+        if (!mask) continue;
+        _mm256_maskstore_pd(depth + x, _mm256_castpd_si256(pass), z);
+        if (mask == 0xF) {
+            col[x] = shaded; col[x + 1] = shaded; col[x + 2] = shaded; col[x + 3] = shaded;
+        } else {
+            for (int k = 0; k < 4; k++) if (mask & (1 << k)) col[x + k] = shaded;
         }
     }
-    
-    for (int i = 0; i < num_vis-1; i++) {
-        for (int j = i+1; j < num_vis; j++) {
-            if (faces[i].depth > faces[j].depth) {
-                Face tmp = faces[i];
-                faces[i] = faces[j];
-                faces[j] = tmp;
-            }
+#endif
+    for (; x <= xe; x++) {
+        double z = zc + dzdx * ((double)x + 0.5);
+        if (z > depth[x] - bias) {
+            depth[x] = z;
+            col[x] = shaded;
         }
     }
+}
 
-    for (int f = 0; f < num_vis; f++) {
-        int idx = faces[f].idx;
-        const int *face = CUBE_FACES[idx];
-        Color col = FACE_COLORS[idx];
-        fill_tri(verts[face[0]], verts[face[1]], verts[face[2]], col, faces[f].brightness);
-        fill_tri(verts[face[0]], verts[face[2]], verts[face[3]], col, faces[f].brightness);
-    }
-    int edges[12][2] = {
-        {0,1},{1,2},{2,3},{3,0},{4,5},{5,6},{6,7},{7,4},{0,4},{1,5},{2,6},{3,7}
-    };
-    for (int e = 0; e < 12; e++) {
-        int v0 = edges[e][0], v1 = edges[e][1];
-        int shared = 0;
-        for (int f = 0; f < num_vis; f++) {
-            const int *face = CUBE_FACES[faces[f].idx];
-            int has_v0 = 0, has_v1 = 0;
-            for (int k = 0; k < 4; k++) {
-                if (face[k] == v0) has_v0 = 1;
-                if (face[k] == v1) has_v1 = 1;
-            }
-            if (has_v0 && has_v1) shared++;
-        }
-        if (shared == 1) {
-            draw_line(verts[v0], verts[v1], rgb(255,255,255));
+/* fill_span() for Gouraud: brightness steps by dldx per sample alongside
+ * depth and scales base. */
+static void fill_span_smooth(Color *col, double *depth, int xs, int xe, double zc, double dzdx,
+                             double lc, double dldx, double bias, Color base) {
+    double px = (double)xs + 0.5;
+    double z = zc + dzdx * px, l = lc + dldx * px;
+    for (int x = xs; x <= xe; x++, z += dzdx, l += dldx) {
+        if (z > depth[x] - bias) {
+            depth[x] = z;
+            col[x] = shade(base, l);
         }
     }
 }
 
-static int handle_input(void) {
-    char c;
-    if (read(0, &c, 1) == 1) {
-        if (c == 'q' || c == 'Q' || c == 27) return 0;
-        if (c == '+' || c == '=') {
-            double nz = zoom * 1.1;
-            if (nz > 5.0) nz = 5.0;
-            zoom = nz;
-        } else if (c == '-' || c == '_') {
-            double nz = zoom / 1.1;
-            if (nz < 0.1) nz = 0.1;
-            zoom = nz;
+/* Textured span: depth, brightness and the perspective terms q, u*q, v*q
+ * all step linearly in x; one divide per sample recovers u and v. */
+static void fill_span_tex(Color *col, double *depth, int xs, int xe, double bias,
+                          const TriPaint *p, const double c[5], const double d[5]) {
+    const Texture *t = p->tex;
+    const Color *texels = t->level[p->level];
+    int s = t->size >> p->level;
+    double px = (double)xs + 0.5;
+    double z = c[0] + d[0] * px, l = c[1] + d[1] * px;
+    double q = c[2] + d[2] * px, uq = c[3] + d[3] * px, vq = c[4] + d[4] * px;
+    for (int x = xs; x <= xe; x++, z += d[0], l += d[1], q += d[2], uq += d[3], vq += d[4]) {
+        if (!(z > depth[x] - bias)) continue;
+        double inv = s / q;
+        int tx = (int)(uq * inv), ty = (int)(vq * inv);
+        tx = tx < 0 ? 0 : tx >= s ? s - 1 : tx;
+        ty = ty < 0 ? 0 : ty >= s ? s - 1 : ty;
+        depth[x] = z;
+        Color texel = texels[tex_index(tx, ty)];
+        col[x] = shade(p->tinted ? tint_color(texel, p->tint) : texel, l);
+    }
+}
+
+/* Per-sample paint_at() for spans whose colour is not a simple step in x
+ * (shadowed); the barycentrics step with the edge functions. */
+static void fill_span_paint(Color *col, double *depth, int xs, int xe, double zc, double dzdx, double bias,
+                            const TriPaint *p, const double a[3], const double b[3], double invA) {
+    double px = (double)xs + 0.5;
+    double z = zc + dzdx * px;
+    double w0 = (a[0] + b[0] * px) * invA, w1 = (a[1] + b[1] * px) * invA, w2 = (a[2] + b[2] * px) * invA;
+    double d0 = b[0] * invA, d1 = b[1] * invA, d2 = b[2] * invA;
+    for (int x = xs; x <= xe; x++, z += dzdx, w0 += d0, w1 += d1, w2 += d2) {
+        if (z > depth[x] - bias) {
+            depth[x] = z;
+            col[x] = paint_at(p, w0, w1, w2);
         }
     }
-    return 1;
 }
 
-int main(void) {
-    int w, h;
-    get_term_size(&w, &h);
-    buf_init(w, h);
-    term_init();
-    
-    struct timeval last_time;
-    gettimeofday(&last_time, NULL);
-    
-    while (1) {
-        struct timeval now;
-        gettimeofday(&now, NULL);
-        
-        double dt = (now.tv_sec - last_time.tv_sec) +
-                   (now.tv_usec - last_time.tv_usec) / 1e6;
-        last_time = now;
-        
-        if (dt > 0.1) dt = 0.1;
-        time_global += dt;
-        rot_x += 0.6 * dt;
-        rot_y += 0.8 * dt;
-        rot_z += 0.4 * dt;
-        
-        if (!handle_input()) break;
-        buf_clear();
-        render_cube();
-        buf_render();
-        usleep(16667);
+/* fill_span_paint() for translucent triangles: the same depth test, but
+ * samples accumulate into the OIT planes and depth is left alone. */
+static void fill_span_oit(int y, const double *depth, int xs, int xe, double zc, double dzdx, double bias,
+                          const TriPaint *p, const double a[3], const double b[3], double invA) {
+    double px = (double)xs + 0.5;
+    double z = zc + dzdx * px;
+    if (!p->smooth && !p->tex && !p->shadow) {
+        for (int x = xs; x <= xe; x++, z += dzdx)
+            if (z > depth[x] - bias) oit_add(y, x, z, p->flat, p->alpha);
+        return;
     }
-    
-    term_cleanup();
-    free(buf.top_color);
-    free(buf.bot_color);
-    free(buf.top_depth);
-    free(buf.bot_depth);
+    double w0 = (a[0] + b[0] * px) * invA, w1 = (a[1] + b[1] * px) * invA, w2 = (a[2] + b[2] * px) * invA;
+    double d0 = b[0] * invA, d1 = b[1] * invA, d2 = b[2] * invA;
+    for (int x = xs; x <= xe; x++, z += dzdx, w0 += d0, w1 += d1, w2 += d2)
+        if (z > depth[x] - bias) oit_add(y, x, z, paint_at(p, w0, w1, w2), p->alpha);
+}
+
+static void raster_span(Vec3 s0, Vec3 s1, Vec3 s2, double area, const TriPaint *paint) {
+    double x0 = s0.x, y0 = s0.y, z0 = s0.z;
+    double x1 = s1.x, y1 = s1.y, z1 = s1.z;
+    double x2 = s2.x, y2 = s2.y, z2 = s2.z;
+    double sign = area > 0 ? 1.0 : -1.0;
+    double invA = 1.0 / area;
+
+    int aa = aa_mode == AA_EDGE;
+    double pad = aa ? 1.0 : 0.0;
+    int min_y = (int)ceil(fmin(y0, fmin(y1, y2)) - 0.5 - pad); if (min_y < 0) min_y = 0;
+    int max_y = (int)floor(fmax(y0, fmax(y1, y2)) - 0.5 + pad); if (max_y >= buf.height * 2) max_y = buf.height * 2 - 1;
+
+    /* Edge functions are linear in px for a fixed row: w = a + b*px. */
+    double b0 = -(y2 - y1), b1 = -(y0 - y2), b2 = -(y1 - y0);
+    double dzdx = (b0 * z0 + b1 * z1 + b2 * z2) * invA;
+    const double *l = paint->light;
+    double dldx = (b0 * l[0] + b1 * l[1] + b2 * l[2]) * invA;
+    /* Textured: z, l, q, uq, vq as row constant c and x step d. */
+    const double *tq[3] = {paint->q, paint->uq, paint->vq};
+    double tc[5], td[5] = {dzdx, dldx, 0, 0, 0};
+    if (paint->tex)
+        for (int k = 0; k < 3; k++) td[2 + k] = (b0 * tq[k][0] + b1 * tq[k][1] + b2 * tq[k][2]) * invA;
+    double len0 = hypot(x2 - x1, y2 - y1);
+    double len1 = hypot(x0 - x2, y0 - y2);
+    double len2 = hypot(x1 - x0, y1 - y0);
+    double il0 = sign / len0, il1 = sign / len1, il2 = sign / len2;
+
+    for (int y = min_y; y <= max_y; y++) {
+        double py = (double)y + 0.5;
+        double a0 = (x2 - x1) * (py - y1) + (y2 - y1) * x1;
+        double a1 = (x0 - x2) * (py - y2) + (y0 - y2) * x2;
+        double a2 = (x1 - x0) * (py - y0) + (y1 - y0) * x0;
+
+        Color *col; double *depth; double bias;
+        sample_row(y, &col, &depth, &bias);
+        double zc = (a0 * z0 + a1 * z1 + a2 * z2) * invA;
+        double lc = (a0 * l[0] + a1 * l[1] + a2 * l[2]) * invA;
+
+        double lo = -1e30, hi = 1e30;
+        int core = edge_span(a0, b0, sign, &lo, &hi) &&
+                   edge_span(a1, b1, sign, &lo, &hi) &&
+                   edge_span(a2, b2, sign, &lo, &hi);
+        double fxs = ceil(lo - 0.5), fxe = floor(hi - 0.5);
+        if (fxs < 0) fxs = 0;
+        if (fxe > buf.width - 1) fxe = buf.width - 1;
+        if (!core || fxs > fxe) { fxs = 1e30; fxe = -1e30; }
+        else if (paint->oit) {
+            const double ea[3] = {a0, a1, a2}, eb[3] = {b0, b1, b2};
+            fill_span_oit(y, depth, (int)fxs, (int)fxe, zc, dzdx, bias, paint, ea, eb, invA);
+        } else if (paint->shadow) {
+            const double ea[3] = {a0, a1, a2}, eb[3] = {b0, b1, b2};
+            fill_span_paint(col, depth, (int)fxs, (int)fxe, zc, dzdx, bias, paint, ea, eb, invA);
+        } else if (paint->tex) {
+            tc[0] = zc;
+            tc[1] = lc;
+            for (int k = 0; k < 3; k++) tc[2 + k] = (a0 * tq[k][0] + a1 * tq[k][1] + a2 * tq[k][2]) * invA;
+            fill_span_tex(col, depth, (int)fxs, (int)fxe, bias, paint, tc, td);
+        } else if (paint->smooth)
+            fill_span_smooth(col, depth, (int)fxs, (int)fxe, zc, dzdx, lc, dldx, bias, paint->base);
+        else fill_span(col, depth, (int)fxs, (int)fxe, zc, dzdx, bias, paint->flat);
+
+        if (!aa) continue;
+        /* Fringe: the span of the triangle dilated by half a sample, minus the core. */
+        double flo = -1e30, fhi = 1e30;
+        if (!edge_span(a0 + 0.5 * sign * len0, b0, sign, &flo, &fhi)) continue;
+        if (!edge_span(a1 + 0.5 * sign * len1, b1, sign, &flo, &fhi)) continue;
+        if (!edge_span(a2 + 0.5 * sign * len2, b2, sign, &flo, &fhi)) continue;
+        int xs = (int)fmax(ceil(flo - 0.5), 0.0);
+        int xe = (int)fmin(floor(fhi - 0.5), buf.width - 1.0);
+        for (int x = xs; x <= xe; x++) {
+            if (x >= fxs && x <= fxe) { x = (int)fxe; continue; }
+            double px = (double)x + 0.5;
+            double d = fmin((a0 + b0 * px) * il0, fmin((a1 + b1 * px) * il1, (a2 + b2 * px) * il2));
+            if (d <= -0.5) continue;
+            Color c = paint->tex || paint->shadow || paint->oit ? paint_at(paint, (a0 + b0 * px) * invA, (a1 + b1 * px) * invA,
+                                            (a2 + b2 * px) * invA)
+                    : paint->smooth ? shade(paint->base, lc + dldx * px) : paint->flat;
+            double z = zc + dzdx * px;
+            if (!paint->oit) blend_sample(col, depth, x, z, bias, c, 0.5 + fmin(d, 0.0));
+            else if (z > depth[x] - bias) oit_add(y, x, z, c, paint->alpha * (0.5 + fmin(d, 0.0)));
+        }
+    }
+}
+
+static void raster_tri(Vec3 s0, Vec3 s1, Vec3 s2, const TriPaint *paint) {
+    double area = (s1.x - s0.x) * (s2.y - s0.y) - (s1.y - s0.y) * (s2.x - s0.x);
+    if (fabs(area) < 1e-8) return;
+    if (paint->tex || paint->shadow) {
+        /* Screen z is view z, so 1/w = 1/-z. The mip level matches one
+         * texel to one sample on average over the triangle; the light-space
+         * position comes from unprojecting each vertex. */
+        TriPaint p = *paint;
+        Vec3 s[3] = {s0, s1, s2};
+        double ps = proj_scale(), cx = buf.width * 0.5, cy = (double)buf.height;
+        for (int k = 0; k < 3; k++) {
+            double w = fmax(-s[k].z, NEAR_W);
+            p.q[k] = 1.0 / w;
+            p.uq[k] = p.u[k] * p.q[k];
+            p.vq[k] = p.v[k] * p.q[k];
+            if (!p.shadow) continue;
+            Vec3 ls = mat4_point(&shadow.from_view, v3((s[k].x - cx) * w / ps, -(s[k].y - cy) * w / ps, s[k].z));
+            p.sxq[k] = ls.x * p.q[k];
+            p.syq[k] = ls.y * p.q[k];
+            p.szq[k] = ls.z * p.q[k];
+        }
+        if (p.tex) {
+            double texels = fabs((p.u[1] - p.u[0]) * (p.v[2] - p.v[0]) - (p.u[2] - p.u[0]) * (p.v[1] - p.v[0]))
+                          * p.tex->size * p.tex->size;
+            int level = texels > fabs(area) ? (int)(0.5 * log2(texels / fabs(area)) + 0.5) : 0;
+            p.level = level < p.tex->levels ? level : p.tex->levels - 1;
+        }
+        if (raster_mode == RASTER_SPAN) raster_span(s0, s1, s2, area, &p);
+        else raster_bbox(s0, s1, s2, area, &p);
+        return;
+    }
+    if (raster_mode == RASTER_SPAN) raster_span(s0, s1, s2, area, paint);
+    else raster_bbox(s0, s1, s2, area, paint);
+}
+
+/* Sutherland-Hodgman against the planes in need, then fan the result. */
+static void clip_raster(ClipVert *poly, int need, const TriPaint *paint) {
+    ClipVert tmp[3 + 6];
+    int n = 3;
+    ClipVert *src = poly, *dst = tmp;
+    for (int plane = CLIP_NEAR; plane <= CLIP_GB_BOTTOM && n >= 3; plane <<= 1) {
+        if (!(need & plane)) continue;
+        n = clip_poly(src, n, dst, plane);
+        ClipVert *t = src; src = dst; dst = t;
+    }
+    if (n < 3) return;
+
+    TriPaint fan = *paint;
+    Vec3 s0 = clip_to_screen(src[0]);
+    Vec3 prev = clip_to_screen(src[1]);
+    for (int i = 2; i < n; i++) {
+        Vec3 cur = clip_to_screen(src[i]);
+        fan.light[0] = src[0].l; fan.light[1] = src[i - 1].l; fan.light[2] = src[i].l;
+        fan.key[0] = src[0].k; fan.key[1] = src[i - 1].k; fan.key[2] = src[i].k;
+        fan.u[0] = src[0].u; fan.u[1] = src[i - 1].u; fan.u[2] = src[i].u;
+        fan.v[0] = src[0].v; fan.v[1] = src[i - 1].v; fan.v[2] = src[i].v;
+        raster_tri(s0, prev, cur, &fan);
+        prev = cur;
+    }
+}
+
+/* Depth-only specialisation of raster_span() for the shadow map: same edge
+ * functions and span bounds, but no colour, shading or per-row buffer
+ * selection. The depth test and write are a single max, so a span is
+ * load, max, store eight texels at a time. */
+static void fill_depth(float *row, int xs, int xe, float zc, float dzdx) {
+    int x = xs;
+#if defined(__AVX__)
+    const __m256 lane = _mm256_set_ps(7.5f, 6.5f, 5.5f, 4.5f, 3.5f, 2.5f, 1.5f, 0.5f);
+    const __m256 vzc = _mm256_set1_ps(zc), vdz = _mm256_set1_ps(dzdx);
+    for (; x + 7 <= xe; x += 8) {
+        __m256 z = _mm256_add_ps(vzc, _mm256_mul_ps(vdz, _mm256_add_ps(_mm256_set1_ps((float)x), lane)));
+        _mm256_storeu_ps(row + x, _mm256_max_ps(_mm256_loadu_ps(row + x), z));
+    }
+#endif
+    for (; x <= xe; x++) row[x] = fmaxf(row[x], zc + dzdx * ((float)x + 0.5f));
+}
+
+static void raster_depth(Vec3 s0, Vec3 s1, Vec3 s2, double area, float *map, int size) {
+    double x0 = s0.x, y0 = s0.y, z0 = s0.z;
+    double x1 = s1.x, y1 = s1.y, z1 = s1.z;
+    double x2 = s2.x, y2 = s2.y, z2 = s2.z;
+    double sign = area > 0 ? 1.0 : -1.0;
+    double invA = 1.0 / area;
+    int min_y = (int)ceil(fmin(y0, fmin(y1, y2)) - 0.5); if (min_y < 0) min_y = 0;
+    int max_y = (int)floor(fmax(y0, fmax(y1, y2)) - 0.5); if (max_y >= size) max_y = size - 1;
+    double b0 = -(y2 - y1), b1 = -(y0 - y2), b2 = -(y1 - y0);
+    float dzdx = (float)((b0 * z0 + b1 * z1 + b2 * z2) * invA);
+    for (int y = min_y; y <= max_y; y++) {
+        double py = (double)y + 0.5;
+        double a0 = (x2 - x1) * (py - y1) + (y2 - y1) * x1;
+        double a1 = (x0 - x2) * (py - y2) + (y0 - y2) * x2;
+        double a2 = (x1 - x0) * (py - y0) + (y1 - y0) * x0;
+        double lo = -1e30, hi = 1e30;
+        if (!edge_span(a0, b0, sign, &lo, &hi) || !edge_span(a1, b1, sign, &lo, &hi) ||
+            !edge_span(a2, b2, sign, &lo, &hi))
+            continue;
+        double xs = fmax(ceil(lo - 0.5), 0.0), xe = fmin(floor(hi - 0.5), size - 1.0);
+        if (xs > xe) continue;
+        fill_depth(map + (size_t)y * (size_t)size, (int)xs, (int)xe,
+                   (float)((a0 * z0 + a1 * z1 + a2 * z2) * invA), dzdx);
+    }
+}
+
+/* Batch outcode() for view-space SoA input, same planes and order. */
+static void soa_outcodes(const float *x, const float *y, const float *z, uint16_t *out, int n) {
+    float s = (float)proj_scale();
+    float hx = (float)(buf.width * 0.5), hy = (float)buf.height;
+    float gx = (float)GUARD_BAND * hx, gy = (float)GUARD_BAND * hy;
+    for (int i = 0; i < n; i++) {
+        float w = -z[i], cx = x[i] * s, cy = -y[i] * s;
+        int code = 0;
+        code |= (w < (float)NEAR_W) ? CLIP_NEAR : 0;
+        code |= (w > (float)FAR_W) ? CLIP_FAR : 0;
+        code |= (cx < -hx * w) ? CLIP_LEFT : 0;
+        code |= (cx > hx * w) ? CLIP_RIGHT : 0;
+        code |= (cy < -hy * w) ? CLIP_TOP : 0;
+        code |= (cy > hy * w) ? CLIP_BOTTOM : 0;
+        code |= (cx < -gx * w) ? CLIP_GB_LEFT : 0;
+        code |= (cx > gx * w) ? CLIP_GB_RIGHT : 0;
+        code |= (cy < -gy * w) ? CLIP_GB_TOP : 0;
+        code |= (cy > gy * w) ? CLIP_GB_BOTTOM : 0;
+        out[i] = (uint16_t)code;
+    }
+}
+
+/* Pair up the half-edges of an indexed polygon list so every edge knows its
+ * two faces (f1 = -1 on an open boundary). The silhouette is then the set of
+ * edges whose faces disagree on facing, found in one pass over the edges.
+ * An edge shared by more than two faces (non-manifold input) is emitted once
+ * for each face after the first, paired with the first, so it outlines when
+ * its faces disagree and never as an open boundary. Half-edges are
+ * counting-sorted by their lower vertex, so pairing only scans each
+ * vertex's few incident edges. edges must hold num_faces * face_size
+ * entries; returns the edge count, or -1 if out of memory. */
+static int build_edges(const int *idx, int face_size, int num_faces, int num_verts, Edge *edges) {
+    int n = num_faces * face_size;
+    int *start = calloc((size_t)num_verts + 1, sizeof(int));
+    Edge *half = malloc((size_t)n * sizeof(Edge));
+    if (!start || !half) {
+        free(start);
+        free(half);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        int a = idx[i], b = idx[i - i % face_size + (i % face_size + 1) % face_size];
+        start[(a < b ? a : b) + 1]++;
+    }
+    for (int v = 0; v < num_verts; v++) start[v + 1] += start[v];
+    for (int i = 0; i < n; i++) {
+        int a = idx[i], b = idx[i - i % face_size + (i % face_size + 1) % face_size];
+        int lo = a < b ? a : b;
+        half[start[lo]++] = (Edge){lo, a < b ? b : a, i / face_size, -1};
+    }
+    int m = 0, s = 0;
+    for (int v = 0; v < num_verts; v++) {
+        int e = start[v];
+        for (int i = s; i < e; i++) {
+            if (half[i].v0 < 0) continue;
+            Edge ed = half[i];
+            int paired = 0;
+            for (int j = i + 1; j < e; j++) {
+                if (half[j].v0 >= 0 && half[j].v1 == ed.v1) {
+                    ed.f1 = half[j].f0;
+                    edges[m++] = ed;
+                    half[j].v0 = -1;
+                    paired = 1;
+                }
+            }
+            if (!paired) edges[m++] = ed;
+        }
+        s = e;
+    }
+    free(half);
+    free(start);
+    return m;
+}
+
+static void mesh_free(Mesh *m) {
+    if (m->map) {
+        if (m->map_size) munmap(m->map, m->map_size);
+    } else {
+        free(m->px);
+        free(m->nx);
+        free(m->idx);
+        free(m->colors);
+        free(m->edges);
+    }
+    free(m->uv);
+    free(m->tex);
+    memset(m, 0, sizeof(*m));
+}
+
+static int mesh_alloc(Mesh *m, int num_verts, int num_tris) {
+    memset(m, 0, sizeof(*m));
+    m->num_verts = num_verts;
+    m->num_tris = num_tris;
+    m->px = alloc_aligned((size_t)num_verts * 3 * sizeof(float));
+    m->nx = alloc_aligned((size_t)num_verts * 3 * sizeof(float));
+    m->idx = malloc((size_t)num_tris * 3 * sizeof(int));
+    m->colors = malloc((size_t)num_tris * sizeof(Color));
+    if (!m->px || !m->nx || !m->idx || !m->colors) {
+        mesh_free(m);
+        return -1;
+    }
+    m->py = m->px + num_verts; m->pz = m->py + num_verts;
+    m->ny = m->nx + num_verts; m->nz = m->ny + num_verts;
+    return 0;
+}
+
+static inline Vec3 mesh_pos(const Mesh *m, int i) {
+    return v3(m->px[i], m->py[i], m->pz[i]);
+}
+
+/* Area-weighted vertex normals, bounding sphere, default face colours and
+ * edge adjacency. Faces without a colour take the cube palette entry for the
+ * dominant axis of their normal. Frees the mesh and returns -1 if the edge
+ * table cannot be allocated. */
+static int mesh_finish(Mesh *m, int have_colors) {
+    memset(m->nx, 0, (size_t)m->num_verts * 3 * sizeof(float));
+    for (int t = 0; t < m->num_tris; t++) {
+        const int *f = m->idx + t * 3;
+        Vec3 n = cross(sub(mesh_pos(m, f[1]), mesh_pos(m, f[0])),
+                       sub(mesh_pos(m, f[2]), mesh_pos(m, f[0])));
+        for (int k = 0; k < 3; k++) {
+            m->nx[f[k]] += (float)n.x;
+            m->ny[f[k]] += (float)n.y;
+            m->nz[f[k]] += (float)n.z;
+        }
+        if (!have_colors) {
+            double ax = fabs(n.x), ay = fabs(n.y), az = fabs(n.z);
+            int face = az >= ax && az >= ay ? (n.z < 0 ? 0 : 1)
+                     : ax >= ay ? (n.x < 0 ? 2 : 3) : (n.y > 0 ? 4 : 5);
+            m->colors[t] = FACE_COLORS[face];
+        }
+    }
+    soa_normalize(m->nx, m->ny, m->nz, m->num_verts);
+
+    Vec3 lo = v3(1e30, 1e30, 1e30), hi = v3(-1e30, -1e30, -1e30);
+    for (int i = 0; i < m->num_verts; i++) {
+        Vec3 p = mesh_pos(m, i);
+        lo = v3(fmin(lo.x, p.x), fmin(lo.y, p.y), fmin(lo.z, p.z));
+        hi = v3(fmax(hi.x, p.x), fmax(hi.y, p.y), fmax(hi.z, p.z));
+    }
+    m->center = m->num_verts ? scale(add(lo, hi), 0.5) : v3(0, 0, 0);
+    m->radius = 0;
+    for (int i = 0; i < m->num_verts; i++)
+        m->radius = fmax(m->radius, length(sub(mesh_pos(m, i), m->center)));
+
+    m->edges = malloc((size_t)m->num_tris * 3 * sizeof(Edge));
+    m->num_edges = m->edges ? build_edges(m->idx, 3, m->num_tris, m->num_verts, m->edges) : -1;
+    if (m->num_edges < 0) {
+        mesh_free(m);
+        return -1;
+    }
+    return 0;
+}
+
+static int mesh_init_cube(Mesh *m) {
+    if (mesh_alloc(m, 8, 12) < 0) return -1;
+    for (int i = 0; i < 8; i++) {
+        m->px[i] = (float)CUBE_VERTS[i].x;
+        m->py[i] = (float)CUBE_VERTS[i].y;
+        m->pz[i] = (float)CUBE_VERTS[i].z;
+    }
+    for (int f = 0; f < 6; f++) {
+        const int *q = CUBE_FACES[f];
+        int *t = m->idx + f * 6;
+        /* CUBE_FACES lists each quad clockwise seen from outside; reverse it
+         * so the triangles wind outward like loaded models. */
+        t[0] = q[0]; t[1] = q[2]; t[2] = q[1];
+        t[3] = q[0]; t[4] = q[3]; t[5] = q[2];
+        m->colors[f * 2] = m->colors[f * 2 + 1] = FACE_COLORS[f];
+    }
+    return mesh_finish(m, 1);
+}
+
+/* Model matrix that centres the mesh and scales its bounding sphere to the
+ * cube's, so any model frames the same way. */
+static Mat4 mesh_fit(const Mesh *m) {
+    double s = m->radius > 1e-12 ? sqrt(3.0) / m->radius : 1.0;
+    Mat4 sc = mat4_identity();
+    sc.m[0][0] = sc.m[1][1] = sc.m[2][2] = s;
+    return mat4_mul(sc, mat4_translate(-m->center.x, -m->center.y, -m->center.z));
+}
+
+/* ---- model loading ---- */
+
+static int map_file(const char *path, const char **data, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) { close(fd); return -1; }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    *data = p;
+    *size = (size_t)st.st_size;
+    return 0;
+}
+
+static int num_workers(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > 16 ? 16 : (int)n);
+}
+
+/* Run fn over n work items, one thread each, the last on the caller. */
+static void run_parallel(void *(*fn)(void *), void *items, size_t item_size, int n) {
+    pthread_t tid[16];
+    int started = 0;
+    for (int i = 0; i < n - 1; i++)
+        if (!pthread_create(&tid[started], NULL, fn, (char *)items + (size_t)i * item_size)) started++;
+        else fn((char *)items + (size_t)i * item_size);
+    fn((char *)items + (size_t)(n - 1) * item_size);
+    for (int i = 0; i < started; i++) pthread_join(tid[i], NULL);
+}
+
+static inline const char *skip_blank(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+/* Locale-free decimal parser; NULL if no number is present. */
+static const char *parse_float(const char *p, const char *end, float *out) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19
+    };
+    p = skip_blank(p, end);
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        if (mant < 1000000000000000000ull) mant = mant * 10 + (uint64_t)(*p - '0');
+        else exp10++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (mant < 1000000000000000000ull) { mant = mant * 10 + (uint64_t)(*p - '0'); exp10--; }
+        }
+    }
+    if (!digits) return NULL;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int eneg = 0, e = 0;
+        if (q < end && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9') {
+            for (; q < end && *q >= '0' && *q <= '9'; q++) if (e < 1000) e = e * 10 + (*q - '0');
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+    double v = (double)mant;
+    if (exp10 < 0) v = exp10 >= -19 ? v / pow10[-exp10] : v * pow(10.0, exp10);
+    else if (exp10 > 0) v = exp10 <= 19 ? v * pow10[exp10] : v * pow(10.0, exp10);
+    *out = (float)(neg ? -v : v);
+    return p;
+}
+
+static const char *parse_int(const char *p, const char *end, long *out) {
+    p = skip_blank(p, end);
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    long v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (v >= 1L << 26) return NULL;     /* longer than any index a Mesh can hold */
+        v = v * 10 + (*p - '0');
+    }
+    *out = neg ? -v : v;
+    return p;
+}
+
+typedef struct {
+    const char *begin, *end;
+    int nv, nt;
+    int v_off, t_off;
+    int total_v;
+    Mesh *m;
+    int err;
+} ObjChunk;
+
+static inline int obj_line_kind(const char *p, const char *end) {
+    if (end - p < 2 || (p[1] != ' ' && p[1] != '\t')) return 0;
+    return *p == 'v' ? 'v' : (*p == 'f' ? 'f' : 0);
+}
+
+/* A face's corners end at a trailing comment. */
+static inline const char *obj_corners_end(const char *p, const char *eol) {
+    const char *hash = memchr(p, '#', (size_t)(eol - p));
+    return hash ? hash : eol;
+}
+
+/* Pass 1: count vertices and fan triangles so every chunk knows where its
+ * output starts. */
+static void *obj_count(void *arg) {
+    ObjChunk *c = arg;
+    for (const char *p = c->begin; p < c->end; ) {
+        const char *eol = memchr(p, '\n', (size_t)(c->end - p));
+        if (!eol) eol = c->end;
+        p = skip_blank(p, eol);
+        int kind = obj_line_kind(p, eol);
+        if (kind == 'v') {
+            c->nv++;
+        } else if (kind == 'f') {
+            const char *fe = obj_corners_end(p, eol);
+            int corners = 0;
+            for (const char *q = p + 1; q < fe; ) {
+                q = skip_blank(q, fe);
+                if (q >= fe) break;
+                corners++;
+                while (q < fe && *q != ' ' && *q != '\t' && *q != '\r') q++;
+            }
+            if (corners >= 3) c->nt += corners - 2;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+/* Pass 2: parse into the chunk's slice of the mesh arrays. Face corners are
+ * v, v/vt, v//vn or v/vt/vn; only the position index is used. */
+static void *obj_parse(void *arg) {
+    ObjChunk *c = arg;
+    Mesh *m = c->m;
+    int v = c->v_off, t = c->t_off;
+    for (const char *p = c->begin; p < c->end && !c->err; ) {
+        const char *eol = memchr(p, '\n', (size_t)(c->end - p));
+        if (!eol) eol = c->end;
+        p = skip_blank(p, eol);
+        int kind = obj_line_kind(p, eol);
+        if (kind == 'v') {
+            float x = 0, y = 0, z = 0;
+            const char *q = parse_float(p + 1, eol, &x);
+            if (q) q = parse_float(q, eol, &y);
+            if (q) q = parse_float(q, eol, &z);
+            if (!q) c->err = 1;
+            m->px[v] = x; m->py[v] = y; m->pz[v] = z;
+            v++;
+        } else if (kind == 'f') {
+            const char *fe = obj_corners_end(p, eol);
+            int first = -1, prev = -1, corners = 0;
+            for (const char *q = p + 1; q < fe; ) {
+                q = skip_blank(q, fe);
+                if (q >= fe) break;
+                long ix;
+                const char *r = parse_int(q, fe, &ix);
+                if (!r) { c->err = 1; break; }
+                long vi = ix > 0 ? ix - 1 : v + ix;
+                if (ix == 0 || vi < 0 || vi >= c->total_v) { c->err = 1; break; }
+                while (r < fe && *r != ' ' && *r != '\t' && *r != '\r') r++;
+                q = r;
+                if (corners == 0) first = (int)vi;
+                else if (corners >= 2) {
+                    m->idx[t * 3] = first;
+                    m->idx[t * 3 + 1] = prev;
+                    m->idx[t * 3 + 2] = (int)vi;
+                    t++;
+                }
+                prev = (int)vi;
+                corners++;
+            }
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+static int load_obj(const char *data, size_t size, Mesh *m) {
+    ObjChunk chunks[16];
+    int n = size < (1u << 20) ? 1 : num_workers();
+    const char *end = data + size;
+    const char *p = data;
+    for (int i = 0; i < n; i++) {
+        const char *e = i == n - 1 ? end : data + size / (size_t)n * (size_t)(i + 1);
+        if (e < p) e = p;
+        if (i < n - 1) {
+            const char *nl = memchr(e, '\n', (size_t)(end - e));
+            e = nl ? nl + 1 : end;
+        }
+        memset(&chunks[i], 0, sizeof(chunks[i]));
+        chunks[i].begin = p;
+        chunks[i].end = e;
+        p = e;
+    }
+    run_parallel(obj_count, chunks, sizeof(ObjChunk), n);
+    int nv = 0, nt = 0;
+    for (int i = 0; i < n; i++) {
+        chunks[i].v_off = nv;
+        chunks[i].t_off = nt;
+        nv += chunks[i].nv;
+        nt += chunks[i].nt;
+    }
+    if (!nv || !nt || mesh_alloc(m, nv, nt) < 0) return -1;
+    for (int i = 0; i < n; i++) {
+        chunks[i].total_v = nv;
+        chunks[i].m = m;
+    }
+    run_parallel(obj_parse, chunks, sizeof(ObjChunk), n);
+    for (int i = 0; i < n; i++) {
+        if (chunks[i].err) { mesh_free(m); return -1; }
+    }
+    return mesh_finish(m, 0);
+}
+
+enum { PLY_NONE, PLY_I8, PLY_U8, PLY_I16, PLY_U16, PLY_I32, PLY_U32, PLY_F32, PLY_F64 };
+
+static int ply_type(const char *s, size_t len) {
+    static const struct { const char *name; int type; } names[] = {
+        {"char", PLY_I8}, {"int8", PLY_I8}, {"uchar", PLY_U8}, {"uint8", PLY_U8},
+        {"short", PLY_I16}, {"int16", PLY_I16}, {"ushort", PLY_U16}, {"uint16", PLY_U16},
+        {"int", PLY_I32}, {"int32", PLY_I32}, {"uint", PLY_U32}, {"uint32", PLY_U32},
+        {"float", PLY_F32}, {"float32", PLY_F32}, {"double", PLY_F64}, {"float64", PLY_F64}
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (strlen(names[i].name) == len && !memcmp(names[i].name, s, len)) return names[i].type;
+    return PLY_NONE;
+}
+
+static inline int ply_size(int type) {
+    static const int sizes[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+    return sizes[type];
+}
+
+static double ply_read(const uint8_t *p, int type, int big) {
+    uint8_t b[8];
+    int n = ply_size(type);
+    for (int i = 0; i < n; i++) b[i] = big ? p[n - 1 - i] : p[i];
+    switch (type) {
+    case PLY_I8:  return (int8_t)b[0];
+    case PLY_U8:  return b[0];
+    case PLY_I16: { int16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_U16: { uint16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_I32: { int32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_U32: { uint32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_F32: { float v; memcpy(&v, b, 4); return v; }
+    case PLY_F64: { double v; memcpy(&v, b, 8); return v; }
+    default:      return 0;
+    }
+}
+
+typedef struct {
+    char name[32];
+    long count;
+    int stride;             /* fixed record size, 0 if it has a list */
+    int x, y, z;            /* vertex: byte offsets, -1 if absent */
+    int xt, yt, zt;
+    int list_count_type, list_index_type, list_pre;   /* face: list layout */
+    int rgb[3], rgbt;       /* face: colour offsets after the list */
+    int post;               /* face: bytes after the list */
+} PlyElement;
+
+static int load_ply(const char *data, size_t size, Mesh *m) {
+    PlyElement el[8];
+    int nel = 0, big = -1;
+    const char *p = data, *end = data + size;
+    if (size < 4 || memcmp(data, "ply", 3)) return -1;
+    for (;;) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) return -1;
+        const char *tok = skip_blank(p, eol);
+        size_t len = (size_t)(eol - tok);
+        if (len >= 10 && !memcmp(tok, "end_header", 10)) { p = eol + 1; break; }
+        char w[4][32] = {{0}};
+        int nw = 0;
+        for (const char *q = tok; q < eol && nw < 4; ) {
+            q = skip_blank(q, eol);
+            const char *s = q;
+            while (q < eol && *q != ' ' && *q != '\t' && *q != '\r') q++;
+            if (q > s) {
+                size_t l = (size_t)(q - s) < 31 ? (size_t)(q - s) : 31;
+                memcpy(w[nw++], s, l);
+            }
+        }
+        if (nw >= 2 && !strcmp(w[0], "format")) {
+            if (!strcmp(w[1], "binary_little_endian")) big = 0;
+            else if (!strcmp(w[1], "binary_big_endian")) big = 1;
+            else return -1;
+        } else if (nw >= 3 && !strcmp(w[0], "element")) {
+            if (nel == 8) return -1;
+            PlyElement *e = &el[nel++];
+            memset(e, 0, sizeof(*e));
+            memcpy(e->name, w[1], sizeof(e->name));
+            e->count = atol(w[2]);
+            e->x = e->y = e->z = -1;
+            e->rgb[0] = e->rgb[1] = e->rgb[2] = -1;
+        } else if (nw >= 3 && !strcmp(w[0], "property") && nel) {
+            PlyElement *e = &el[nel - 1];
+            if (!strcmp(w[1], "list")) {
+                if (nw < 4 || e->list_count_type) return -1;
+                e->list_count_type = ply_type(w[2], strlen(w[2]));
+                e->list_index_type = ply_type(w[3], strlen(w[3]));
+                e->list_pre = e->stride;
+                if (!e->list_count_type || !e->list_index_type) return -1;
+            } else {
+                int type = ply_type(w[1], strlen(w[1]));
+                if (!type) return -1;
+                int *off = e->list_count_type ? &e->post : &e->stride;
+                if (!strcmp(w[2], "x")) { e->x = *off; e->xt = type; }
+                else if (!strcmp(w[2], "y")) { e->y = *off; e->yt = type; }
+                else if (!strcmp(w[2], "z")) { e->z = *off; e->zt = type; }
+                else if (e->list_count_type && type == PLY_U8) {
+                    if (!strcmp(w[2], "red")) e->rgb[0] = e->post;
+                    else if (!strcmp(w[2], "green")) e->rgb[1] = e->post;
+                    else if (!strcmp(w[2], "blue")) e->rgb[2] = e->post;
+                }
+                *off += ply_size(type);
+            }
+        }
+        p = eol + 1;
+    }
+    if (big < 0) return -1;
+
+    PlyElement *ve = NULL, *fe = NULL;
+    const uint8_t *vdata = NULL, *fdata = NULL;
+    const uint8_t *q = (const uint8_t *)p, *qend = (const uint8_t *)end;
+    for (int i = 0; i < nel; i++) {
+        PlyElement *e = &el[i];
+        if (!strcmp(e->name, "vertex")) { ve = e; vdata = q; }
+        else if (!strcmp(e->name, "face")) { fe = e; fdata = q; }
+        if (!e->list_count_type) {
+            if ((size_t)(qend - q) / (size_t)(e->stride ? e->stride : 1) < (size_t)e->count) return -1;
+            q += (size_t)e->stride * (size_t)e->count;
+        } else if (e != fe) {
+            return -1;
+        } else {
+            int cs = ply_size(e->list_count_type), is = ply_size(e->list_index_type);
+            for (long f = 0; f < e->count; f++) {
+                if (qend - q < e->list_pre + cs) return -1;
+                long k = (long)ply_read(q + e->list_pre, e->list_count_type, big);
+                long rec = e->list_pre + cs + k * is + e->post;
+                if (k < 0 || qend - q < rec) return -1;
+                q += rec;
+            }
+        }
+    }
+    if (!ve || !fe || ve->x < 0 || ve->y < 0 || ve->z < 0 || !fe->list_count_type) return -1;
+    if (ve->count <= 0 || ve->count > INT32_MAX / 3) return -1;
+
+    int cs = ply_size(fe->list_count_type), is = ply_size(fe->list_index_type);
+    long nt = 0;
+    q = fdata;
+    for (long f = 0; f < fe->count; f++) {
+        long k = (long)ply_read(q + fe->list_pre, fe->list_count_type, big);
+        if (k >= 3) nt += k - 2;
+        q += fe->list_pre + cs + k * is + fe->post;
+    }
+    if (!nt || nt > INT32_MAX / 3 || mesh_alloc(m, (int)ve->count, (int)nt) < 0) return -1;
+
+    for (long i = 0; i < ve->count; i++) {
+        const uint8_t *r = vdata + (size_t)i * (size_t)ve->stride;
+        m->px[i] = (float)ply_read(r + ve->x, ve->xt, big);
+        m->py[i] = (float)ply_read(r + ve->y, ve->yt, big);
+        m->pz[i] = (float)ply_read(r + ve->z, ve->zt, big);
+    }
+    int have_colors = fe->rgb[0] >= 0 && fe->rgb[1] >= 0 && fe->rgb[2] >= 0;
+    int t = 0;
+    q = fdata;
+    for (long f = 0; f < fe->count; f++) {
+        long k = (long)ply_read(q + fe->list_pre, fe->list_count_type, big);
+        const uint8_t *ix = q + fe->list_pre + cs;
+        const uint8_t *post = ix + k * is;
+        long first = (long)ply_read(ix, fe->list_index_type, big);
+        for (long c = 2; c < k; c++) {
+            long b = (long)ply_read(ix + (c - 1) * is, fe->list_index_type, big);
+            long d = (long)ply_read(ix + c * is, fe->list_index_type, big);
+            if (first < 0 || b < 0 || d < 0 || first >= ve->count || b >= ve->count || d >= ve->count) {
+                mesh_free(m);
+                return -1;
+            }
+            m->idx[t * 3] = (int)first;
+            m->idx[t * 3 + 1] = (int)b;
+            m->idx[t * 3 + 2] = (int)d;
+            if (have_colors) m->colors[t] = rgb(post[fe->rgb[0]], post[fe->rgb[1]], post[fe->rgb[2]]);
+            t++;
+        }
+        q = post + fe->post;
+    }
+    return mesh_finish(m, have_colors);
+}
+
+/* ---- textures ----
+ * Images load from binary or ASCII PPM and from PNG through a small
+ * inflate, so there is no image library to link. They are resampled to a
+ * power-of-two square and stored with a full mip chain, each level in
+ * Morton order so a triangle's footprint stays within a few cache lines. */
+
+typedef struct {
+    const uint8_t *in;
+    size_t in_len, pos;
+    uint32_t bitbuf;
+    int bitcnt;
+    uint8_t *out;
+    size_t out_len, out_cap;
+} Inflate;
+
+typedef struct { short count[16], symbol[288]; } Huffman;
+
+static const short INF_LBASE[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,
+                                    67,83,99,115,131,163,195,227,258};
+static const short INF_LEXT[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const short INF_DBASE[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+                                    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const short INF_DEXT[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+/* Next need bits, LSB first; -1 past the end of input. */
+static int inf_bits(Inflate *s, int need) {
+    uint32_t val = s->bitbuf;
+    while (s->bitcnt < need) {
+        if (s->pos >= s->in_len) return -1;
+        val |= (uint32_t)s->in[s->pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = need < 32 ? val >> need : 0;
+    s->bitcnt -= need;
+    return (int)(val & ((1u << need) - 1));
+}
+
+static int inf_reserve(Inflate *s, size_t n) {
+    if (s->out_len + n <= s->out_cap) return 0;
+    size_t cap = s->out_cap ? s->out_cap : 65536;
+    while (cap < s->out_len + n) cap *= 2;
+    uint8_t *p = realloc(s->out, cap);
+    if (!p) return -1;
+    s->out = p;
+    s->out_cap = cap;
+    return 0;
+}
+
+/* Canonical Huffman code from code lengths. Incomplete codes are allowed
+ * (a single distance code is legal); over-subscribed ones are not. */
+static int inf_build(Huffman *h, const short *lengths, int n) {
+    short offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    for (int i = 0; i < n; i++) h->count[lengths[i]]++;
+    if (h->count[0] == n) return 0;
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left = left * 2 - h->count[len];
+        if (left < 0) return -1;
+    }
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) offs[len + 1] = (short)(offs[len] + h->count[len]);
+    for (int i = 0; i < n; i++)
+        if (lengths[i]) h->symbol[offs[lengths[i]]++] = (short)i;
+    return 0;
+}
+
+static int inf_decode(Inflate *s, const Huffman *h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        int b = inf_bits(s, 1);
+        if (b < 0) return -1;
+        code |= b;
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int inf_codes(Inflate *s, const Huffman *lit, const Huffman *dist) {
+    for (;;) {
+        int sym = inf_decode(s, lit);
+        if (sym < 0) return -1;
+        if (sym < 256) {
+            if (inf_reserve(s, 1) < 0) return -1;
+            s->out[s->out_len++] = (uint8_t)sym;
+            continue;
+        }
+        if (sym == 256) return 0;
+        sym -= 257;
+        if (sym >= 29) return -1;
+        int e = inf_bits(s, INF_LEXT[sym]);
+        if (e < 0) return -1;
+        size_t len = (size_t)(INF_LBASE[sym] + e);
+        int ds = inf_decode(s, dist);
+        if (ds < 0 || ds >= 30 || (e = inf_bits(s, INF_DEXT[ds])) < 0) return -1;
+        size_t d = (size_t)(INF_DBASE[ds] + e);
+        if (d > s->out_len || inf_reserve(s, len) < 0) return -1;
+        for (size_t k = 0; k < len; k++, s->out_len++) s->out[s->out_len] = s->out[s->out_len - d];
+    }
+}
+
+static int inf_dynamic(Inflate *s, Huffman *lit, Huffman *dist) {
+    static const uint8_t order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+    short lengths[320];
+    int nlen = inf_bits(s, 5) + 257, ndist = inf_bits(s, 5) + 1, ncode = inf_bits(s, 4) + 4;
+    if (nlen > 286 || ndist > 30 || ncode < 4) return -1;
+    memset(lengths, 0, sizeof(lengths));
+    for (int i = 0; i < ncode; i++) {
+        int b = inf_bits(s, 3);
+        if (b < 0) return -1;
+        lengths[order[i]] = (short)b;
+    }
+    if (inf_build(lit, lengths, 19) < 0) return -1;
+    for (int i = 0; i < nlen + ndist;) {
+        int sym = inf_decode(s, lit);
+        if (sym < 0) return -1;
+        if (sym < 16) { lengths[i++] = (short)sym; continue; }
+        int rep, val = 0;
+        if (sym == 16) {
+            if (!i) return -1;
+            val = lengths[i - 1];
+            rep = 3 + inf_bits(s, 2);
+        } else {
+            rep = sym == 17 ? 3 + inf_bits(s, 3) : 11 + inf_bits(s, 7);
+        }
+        if (rep < 3 || i + rep > nlen + ndist) return -1;
+        while (rep--) lengths[i++] = (short)val;
+    }
+    if (!lengths[256]) return -1;
+    if (inf_build(lit, lengths, nlen) < 0 || inf_build(dist, lengths + nlen, ndist) < 0) return -1;
+    return 0;
+}
+
+/* zlib stream -> malloc'd bytes. The Adler-32 trailer is not checked. */
+static uint8_t *inflate_zlib(const uint8_t *in, size_t len, size_t *out_len) {
+    if (len < 2 || (in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 || (in[1] & 0x20)) return NULL;
+    Inflate s = {in, len, 2, 0, 0, NULL, 0, 0};
+    int last = 0;
+    while (!last) {
+        last = inf_bits(&s, 1);
+        int type = inf_bits(&s, 2);
+        int r = -1;
+        if (last < 0 || type < 0) break;
+        if (type == 0) {
+            s.bitbuf = 0;
+            s.bitcnt = 0;
+            if (s.pos + 4 > s.in_len) break;
+            size_t n = (size_t)(in[s.pos] | in[s.pos + 1] << 8);
+            if ((n ^ 0xFFFF) != (size_t)(in[s.pos + 2] | in[s.pos + 3] << 8)) break;
+            s.pos += 4;
+            if (s.pos + n > s.in_len || inf_reserve(&s, n) < 0) break;
+            memcpy(s.out + s.out_len, in + s.pos, n);
+            s.out_len += n;
+            s.pos += n;
+            r = 0;
+        } else if (type == 1) {
+            static Huffman lit, dist;
+            static int built;
+            if (!built) {
+                short l[288];
+                for (int i = 0; i < 288; i++) l[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+                inf_build(&lit, l, 288);
+                for (int i = 0; i < 30; i++) l[i] = 5;
+                inf_build(&dist, l, 30);
+                built = 1;
+            }
+            r = inf_codes(&s, &lit, &dist);
+        } else if (type == 2) {
+            Huffman lit, dist;
+            r = inf_dynamic(&s, &lit, &dist);
+            if (r == 0) r = inf_codes(&s, &lit, &dist);
+        }
+        if (r < 0) {
+            free(s.out);
+            return NULL;
+        }
+    }
+    if (!last || last < 0) {
+        free(s.out);
+        return NULL;
+    }
+    *out_len = s.out_len;
+    return s.out;
+}
+
+static inline uint32_t be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline int paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/* Non-interlaced PNG of any colour type at 8 bits (16 keeps the high byte;
+ * palettes 8 bits only) into packed RGB. Alpha is dropped. */
+static int load_png(const uint8_t *d, size_t size, uint8_t **rgb, int *w, int *h) {
+    static const uint8_t sig[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    if (size < 8 || memcmp(d, sig, 8)) return -1;
+    int width = 0, height = 0, depth = 0, ctype = -1, have_ihdr = 0;
+    uint8_t plte[256 * 3] = {0};
+    uint8_t *idat = NULL;
+    size_t idat_len = 0, pos = 8;
+    int ok = 0;
+    while (pos + 12 <= size) {
+        uint32_t len = be32(d + pos);
+        const uint8_t *type = d + pos + 4, *body = d + pos + 8;
+        if (len > size - pos - 12) break;
+        if (!memcmp(type, "IHDR", 4) && len >= 13) {
+            width = (int)be32(body);
+            height = (int)be32(body + 4);
+            depth = body[8];
+            ctype = body[9];
+            have_ihdr = body[12] == 0;
+        } else if (!memcmp(type, "PLTE", 4)) {
+            memcpy(plte, body, len < sizeof(plte) ? len : sizeof(plte));
+        } else if (!memcmp(type, "IDAT", 4)) {
+            uint8_t *p = realloc(idat, idat_len + len);
+            if (!p) break;
+            idat = p;
+            memcpy(idat + idat_len, body, len);
+            idat_len += len;
+        } else if (!memcmp(type, "IEND", 4)) {
+            ok = 1;
+            break;
+        }
+        pos += 12 + (size_t)len;
+    }
+    int channels = ctype == 0 ? 1 : ctype == 2 ? 3 : ctype == 3 ? 1 : ctype == 4 ? 2 : ctype == 6 ? 4 : 0;
+    if (!ok || !have_ihdr || !channels || width <= 0 || height <= 0 || width > 16384 || height > 16384 ||
+        !(depth == 8 || (depth == 16 && ctype != 3))) {
+        free(idat);
+        return -1;
+    }
+    size_t bpp = (size_t)channels * (size_t)depth / 8, stride = (size_t)width * bpp, raw_len = 0;
+    uint8_t *raw = inflate_zlib(idat, idat_len, &raw_len);
+    free(idat);
+    if (!raw || raw_len < (stride + 1) * (size_t)height) {
+        free(raw);
+        return -1;
+    }
+    uint8_t *out = malloc((size_t)width * (size_t)height * 3);
+    if (!out) {
+        free(raw);
+        return -1;
+    }
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = raw + (size_t)y * (stride + 1) + 1;
+        const uint8_t *up = y ? row - stride - 1 : NULL;
+        int filter = row[-1];
+        if (filter > 4) {
+            free(raw);
+            free(out);
+            return -1;
+        }
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0, b = up ? up[i] : 0;
+            int c = up && i >= bpp ? up[i - bpp] : 0;
+            switch (filter) {
+            case 1: row[i] = (uint8_t)(row[i] + a); break;
+            case 2: row[i] = (uint8_t)(row[i] + b); break;
+            case 3: row[i] = (uint8_t)(row[i] + (a + b) / 2); break;
+            case 4: row[i] = (uint8_t)(row[i] + paeth(a, b, c)); break;
+            default: break;         /* 0: none */
+            }
+        }
+        size_t step = (size_t)depth / 8;
+        for (int x = 0; x < width; x++) {
+            const uint8_t *px = row + (size_t)x * bpp;
+            uint8_t *o = out + ((size_t)y * (size_t)width + (size_t)x) * 3;
+            if (ctype == 3) {
+                memcpy(o, plte + px[0] * 3, 3);
+            } else if (channels >= 3) {
+                o[0] = px[0]; o[1] = px[step]; o[2] = px[2 * step];
+            } else {
+                o[0] = o[1] = o[2] = px[0];
+            }
+        }
+    }
+    free(raw);
+    *rgb = out;
+    *w = width;
+    *h = height;
+    return 0;
+}
+
+static const uint8_t *ppm_int(const uint8_t *p, const uint8_t *end, int *out) {
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+        if (p < end && *p == '#') { while (p < end && *p != '\n') p++; continue; }
+        break;
+    }
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    long v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && v < 1 << 20) v = v * 10 + (*p++ - '0');
+    *out = (int)v;
+    return p;
+}
+
+/* P6 (binary) or P3 (ASCII) PPM with maxval up to 65535. */
+static int load_ppm(const uint8_t *d, size_t size, uint8_t **rgb, int *w, int *h) {
+    const uint8_t *end = d + size, *p = d + 2;
+    int width, height, maxval;
+    if (size < 2 || d[0] != 'P' || (d[1] != '6' && d[1] != '3')) return -1;
+    if (!(p = ppm_int(p, end, &width)) || !(p = ppm_int(p, end, &height)) ||
+        !(p = ppm_int(p, end, &maxval)))
+        return -1;
+    if (width <= 0 || height <= 0 || width > 16384 || height > 16384 || maxval <= 0 || maxval > 65535)
+        return -1;
+    size_t n = (size_t)width * (size_t)height * 3;
+    uint8_t *out = malloc(n);
+    if (!out) return -1;
+    if (d[1] == '6') {
+        size_t bytes = maxval > 255 ? 2 : 1;
+        p++;
+        if ((size_t)(end - p) < n * bytes) { free(out); return -1; }
+        for (size_t i = 0; i < n; i++) {
+            int v = bytes == 2 ? p[i * 2] << 8 | p[i * 2 + 1] : p[i];
+            out[i] = (uint8_t)(v * 255 / maxval);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            int v;
+            if (!(p = ppm_int(p, end, &v))) { free(out); return -1; }
+            out[i] = (uint8_t)((v > maxval ? maxval : v) * 255 / maxval);
+        }
+    }
+    *rgb = out;
+    *w = width;
+    *h = height;
+    return 0;
+}
+
+static void texture_free(Texture *t) {
+    free(t->level[0]);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Box-filter src (w x h) into a square power-of-two level 0, then halve
+ * 2x2 blocks down to 1x1. Adjacent Morton indices 4k..4k+3 are exactly the
+ * 2x2 block behind texel k of the next level. */
+static int texture_build(Texture *t, const uint8_t *src, int w, int h) {
+    int size = 1;
+    while (size < (w > h ? w : h) && size < TEX_MAX_SIZE) size *= 2;
+    memset(t, 0, sizeof(*t));
+    t->size = size;
+    size_t total = 0;
+    for (int s = size; s; s /= 2) total += (size_t)s * (size_t)s, t->levels++;
+    Color *base = malloc(total * sizeof(Color));
+    if (!base) return -1;
+    texture_init_morton();
+    for (int l = 0, s = size; l < t->levels; l++, s /= 2) {
+        t->level[l] = base;
+        base += (size_t)s * (size_t)s;
+    }
+    for (int y = 0; y < size; y++) {
+        int y0 = y * h / size, y1 = (y + 1) * h / size;
+        if (y1 <= y0) y1 = y0 + 1;
+        for (int x = 0; x < size; x++) {
+            int x0 = x * w / size, x1 = (x + 1) * w / size;
+            if (x1 <= x0) x1 = x0 + 1;
+            unsigned r = 0, g = 0, b = 0, n = 0;
+            for (int sy = y0; sy < y1; sy++)
+                for (int sx = x0; sx < x1; sx++, n++) {
+                    const uint8_t *p = src + ((size_t)sy * (size_t)w + (size_t)sx) * 3;
+                    r += p[0]; g += p[1]; b += p[2];
+                }
+            t->level[0][tex_index(x, y)] = rgb((uint8_t)(r / n), (uint8_t)(g / n), (uint8_t)(b / n));
+        }
+    }
+    for (int l = 1, s = size / 2; l < t->levels; l++, s /= 2) {
+        const Color *up = t->level[l - 1];
+        for (size_t i = 0; i < (size_t)s * (size_t)s; i++) {
+            const Color *q = up + i * 4;
+            t->level[l][i] = rgb((uint8_t)((q[0].r + q[1].r + q[2].r + q[3].r + 2) / 4),
+                                 (uint8_t)((q[0].g + q[1].g + q[2].g + q[3].g + 2) / 4),
+                                 (uint8_t)((q[0].b + q[1].b + q[2].b + q[3].b + 2) / 4));
+        }
+    }
+    return 0;
+}
+
+static void textures_free(void) {
+    for (int i = 0; i < num_textures; i++) texture_free(&textures[i]);
+    num_textures = 0;
+}
+
+static int texture_load(const char *path, Texture *t) {
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0) return -1;
+    uint8_t *rgb = NULL;
+    int w, h;
+    const uint8_t *d = (const uint8_t *)data;
+    int r = size > 1 && d[0] == 'P' ? load_ppm(d, size, &rgb, &w, &h) : load_png(d, size, &rgb, &w, &h);
+    munmap((void *)data, size);
+    if (r == 0) r = texture_build(t, rgb, w, h);
+    free(rgb);
+    return r;
+}
+
+/* Checkerboard with a colour gradient, for the benchmark when no image is
+ * given. */
+static int texture_checker(Texture *t, int size) {
+    uint8_t *rgb = malloc((size_t)size * (size_t)size * 3);
+    if (!rgb) return -1;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            uint8_t *p = rgb + ((size_t)y * (size_t)size + (size_t)x) * 3;
+            int on = ((x / 8) ^ (y / 8)) & 1;
+            p[0] = (uint8_t)(on ? 255 : x * 255 / size);
+            p[1] = (uint8_t)(on ? 255 : y * 255 / size);
+            p[2] = (uint8_t)(on ? 255 : 96);
+        }
+    int r = texture_build(t, rgb, size, size);
+    free(rgb);
+    return r;
+}
+
+/* Box-projected texture coordinates: each triangle takes the slot of its
+ * dominant normal axis (the six classes of the default colours) and planar
+ * UVs over the mesh bounds on the other two axes, oriented so every face of
+ * the cube shows its image upright and unmirrored from outside. */
+static int mesh_box_uv(Mesh *m) {
+    free(m->uv);
+    free(m->tex);
+    m->uv = malloc((size_t)m->num_tris * 6 * sizeof(float));
+    m->tex = malloc((size_t)m->num_tris);
+    if (!m->uv || !m->tex) {
+        free(m->uv);
+        free(m->tex);
+        m->uv = NULL;
+        m->tex = NULL;
+        return -1;
+    }
+    Vec3 lo = v3(1e30, 1e30, 1e30), hi = v3(-1e30, -1e30, -1e30);
+    for (int i = 0; i < m->num_verts; i++) {
+        Vec3 p = mesh_pos(m, i);
+        lo = v3(fmin(lo.x, p.x), fmin(lo.y, p.y), fmin(lo.z, p.z));
+        hi = v3(fmax(hi.x, p.x), fmax(hi.y, p.y), fmax(hi.z, p.z));
+    }
+    Vec3 ext = sub(hi, lo);
+    Vec3 inv = v3(ext.x > 1e-12 ? 1 / ext.x : 0, ext.y > 1e-12 ? 1 / ext.y : 0, ext.z > 1e-12 ? 1 / ext.z : 0);
+    for (int t = 0; t < m->num_tris; t++) {
+        const int *f = m->idx + t * 3;
+        Vec3 n = cross(sub(mesh_pos(m, f[1]), mesh_pos(m, f[0])),
+                       sub(mesh_pos(m, f[2]), mesh_pos(m, f[0])));
+        double ax = fabs(n.x), ay = fabs(n.y), az = fabs(n.z);
+        int face = az >= ax && az >= ay ? (n.z < 0 ? 0 : 1)
+                 : ax >= ay ? (n.x < 0 ? 2 : 3) : (n.y > 0 ? 4 : 5);
+        m->tex[t] = (uint8_t)face;
+        for (int k = 0; k < 3; k++) {
+            Vec3 p = sub(mesh_pos(m, f[k]), lo);
+            double x = p.x * inv.x, y = p.y * inv.y, z = p.z * inv.z, u, v;
+            switch (face) {
+            case 0:  u = 1 - x; v = 1 - y; break;     /* -z */
+            case 1:  u = x;     v = 1 - y; break;     /* +z */
+            case 2:  u = z;     v = 1 - y; break;     /* -x */
+            case 3:  u = 1 - z; v = 1 - y; break;     /* +x */
+            case 4:  u = x;     v = z;     break;     /* +y */
+            default: u = x;     v = 1 - z; break;     /* -y */
+            }
+            m->uv[t * 6 + k * 2] = (float)u;
+            m->uv[t * 6 + k * 2 + 1] = (float)v;
+        }
+    }
+    return 0;
+}
+
+/* ---- level of detail ---- */
+
+/* Quadric error edge collapse in the style of Garland and Heckbert, run as
+ * threshold sweeps instead of a priority queue: each pass collapses every
+ * edge whose error is under a rising threshold, and the vertex-triangle
+ * references are rebuilt every few passes. Triangles keep their colour;
+ * collapses that would flip a neighbour are refused. */
+
+typedef struct {
+    double q[10];           /* symmetric 4x4 quadric, upper triangle */
+    double x, y, z;
+    int tstart, tcount;
+    uint8_t border;
+} QVert;
+
+typedef struct {
+    int v[3];
+    double err[4];          /* per edge, then the minimum */
+    Vec3 n;
+    Color color;
+    uint8_t deleted, dirty;
+} QTri;
+
+typedef struct { int tri, corner; } QRef;
+
+static struct {
+    QVert *verts;
+    QTri *tris;
+    QRef *refs;
+    int num_verts, num_tris, num_refs, cap_refs;
+    uint8_t *flip0, *flip1;
+    int cap_flip;
+} qs;
+
+static void quadric_plane(double *q, double a, double b, double c, double d) {
+    q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+    q[4] += b * b; q[5] += b * c; q[6] += b * d;
+    q[7] += c * c; q[8] += c * d;
+    q[9] += d * d;
+}
+
+static double quadric_eval(const double *q, double x, double y, double z) {
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+         + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+         + q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+static inline double det3(double a, double b, double c, double d, double e, double f,
+                          double g, double h, double i) {
+    return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+/* Error of collapsing v0-v1 and the position it would collapse to: the
+ * quadric minimum when solvable, otherwise the best of the end points and
+ * midpoint. Border pairs stay on one of their end points. */
+static double qs_edge_error(int i0, int i1, Vec3 *out) {
+    const QVert *a = &qs.verts[i0], *b = &qs.verts[i1];
+    double q[10];
+    for (int k = 0; k < 10; k++) q[k] = a->q[k] + b->q[k];
+    double det = det3(q[0], q[1], q[2], q[1], q[4], q[5], q[2], q[5], q[7]);
+    if (fabs(det) > 1e-12 && !(a->border && b->border)) {
+        double inv = 1.0 / det;
+        Vec3 p = v3(det3(-q[3], q[1], q[2], -q[6], q[4], q[5], -q[8], q[5], q[7]) * inv,
+                    det3(q[0], -q[3], q[2], q[1], -q[6], q[5], q[2], -q[8], q[7]) * inv,
+                    det3(q[0], q[1], -q[3], q[1], q[4], -q[6], q[2], q[5], -q[8]) * inv);
+        *out = p;
+        return quadric_eval(q, p.x, p.y, p.z);
+    }
+    Vec3 c[3] = {v3(a->x, a->y, a->z), v3(b->x, b->y, b->z),
+                 v3((a->x + b->x) * 0.5, (a->y + b->y) * 0.5, (a->z + b->z) * 0.5)};
+    double best = 0;
+    for (int k = 0; k < 3; k++) {
+        double e = quadric_eval(q, c[k].x, c[k].y, c[k].z);
+        if (k == 0 || e < best) { best = e; *out = c[k]; }
+    }
+    return best;
+}
+
+static void qs_tri_errors(QTri *t) {
+    Vec3 p;
+    for (int j = 0; j < 3; j++) t->err[j] = qs_edge_error(t->v[j], t->v[(j + 1) % 3], &p);
+    t->err[3] = fmin(t->err[0], fmin(t->err[1], t->err[2]));
+}
+
+static int qs_push_ref(QRef r) {
+    if (qs.num_refs == qs.cap_refs) {
+        int cap = qs.cap_refs ? qs.cap_refs * 2 : 1024;
+        QRef *p = realloc(qs.refs, (size_t)cap * sizeof(QRef));
+        if (!p) return -1;
+        qs.refs = p;
+        qs.cap_refs = cap;
+    }
+    qs.refs[qs.num_refs++] = r;
+    return 0;
+}
+
+/* Would moving vertex i0 (collapsing onto i1) to p fold any of its other
+ * triangles over? flip[k] marks the triangles shared with i1, which the
+ * collapse removes. */
+static int qs_flipped(Vec3 p, int i0, int i1, uint8_t *flip) {
+    const QVert *v = &qs.verts[i0];
+    for (int k = 0; k < v->tcount; k++) {
+        QRef r = qs.refs[v->tstart + k];
+        const QTri *t = &qs.tris[r.tri];
+        if (t->deleted) continue;
+        int id1 = t->v[(r.corner + 1) % 3], id2 = t->v[(r.corner + 2) % 3];
+        if (id1 == i1 || id2 == i1) { flip[k] = 1; continue; }
+        flip[k] = 0;
+        Vec3 d1 = normalize(sub(v3(qs.verts[id1].x, qs.verts[id1].y, qs.verts[id1].z), p));
+        Vec3 d2 = normalize(sub(v3(qs.verts[id2].x, qs.verts[id2].y, qs.verts[id2].z), p));
+        if (fabs(dot(d1, d2)) > 0.999) return 1;
+        if (dot(normalize(cross(d1, d2)), t->n) < 0.2) return 1;
+    }
+    return 0;
+}
+
+/* Re-point vertex v's live triangles at i0, dropping the flipped ones.
+ * Returns the number dropped, or -1 if a reference cannot be stored. */
+static int qs_retarget(int i0, int v, const uint8_t *flip) {
+    int removed = 0;
+    int start = qs.verts[v].tstart, count = qs.verts[v].tcount;
+    for (int k = 0; k < count; k++) {
+        QRef r = qs.refs[start + k];
+        QTri *t = &qs.tris[r.tri];
+        if (t->deleted) continue;
+        if (flip[k]) { t->deleted = 1; removed++; continue; }
+        t->v[r.corner] = i0;
+        t->dirty = 1;
+        qs_tri_errors(t);
+        if (qs_push_ref(r) < 0) return -1;
+    }
+    return removed;
+}
+
+/* Drop deleted triangles and rebuild the vertex-triangle references. The
+ * first call also finds border vertices and accumulates plane quadrics.
+ * Returns -1 if the references cannot be allocated. */
+static int qs_rebuild(int first) {
+    if (!first) {
+        int n = 0;
+        for (int i = 0; i < qs.num_tris; i++)
+            if (!qs.tris[i].deleted) qs.tris[n++] = qs.tris[i];
+        qs.num_tris = n;
+    }
+    for (int i = 0; i < qs.num_verts; i++) qs.verts[i].tcount = 0;
+    for (int i = 0; i < qs.num_tris; i++)
+        for (int j = 0; j < 3; j++) qs.verts[qs.tris[i].v[j]].tcount++;
+    int start = 0;
+    for (int i = 0; i < qs.num_verts; i++) {
+        qs.verts[i].tstart = start;
+        start += qs.verts[i].tcount;
+        qs.verts[i].tcount = 0;
+    }
+    qs.num_refs = 0;
+    if (start > qs.cap_refs) {
+        QRef *p = realloc(qs.refs, (size_t)start * sizeof(QRef));
+        if (!p) return -1;
+        qs.refs = p;
+        qs.cap_refs = start;
+    }
+    for (int i = 0; i < qs.num_tris; i++)
+        for (int j = 0; j < 3; j++) {
+            QVert *v = &qs.verts[qs.tris[i].v[j]];
+            qs.refs[v->tstart + v->tcount++] = (QRef){i, j};
+        }
+    qs.num_refs = start;
+    if (!first) return 0;
+
+    /* An edge used by only one triangle is a border; its vertices are
+     * pinned against interior collapses. */
+    int cap = 0, *ids = NULL, *cnt = NULL;
+    for (int i = 0; i < qs.num_verts; i++) {
+        QVert *v = &qs.verts[i];
+        int n = 0;
+        if (v->tcount * 2 > cap) {
+            cap = v->tcount * 2;
+            free(ids);
+            free(cnt);
+            ids = malloc((size_t)cap * sizeof(int));
+            cnt = malloc((size_t)cap * sizeof(int));
+            if (!ids || !cnt) {
+                free(ids);
+                free(cnt);
+                return -1;
+            }
+        }
+        for (int k = 0; k < v->tcount; k++) {
+            const QTri *t = &qs.tris[qs.refs[v->tstart + k].tri];
+            for (int j = 0; j < 3; j++) {
+                int id = t->v[j], m = 0;
+                if (id == i) continue;
+                while (m < n && ids[m] != id) m++;
+                if (m == n) { ids[n] = id; cnt[n++] = 1; }
+                else cnt[m]++;
+            }
+        }
+        for (int m = 0; m < n; m++)
+            if (cnt[m] == 1) qs.verts[i].border = qs.verts[ids[m]].border = 1;
+    }
+    free(ids);
+    free(cnt);
+
+    for (int i = 0; i < qs.num_tris; i++) {
+        QTri *t = &qs.tris[i];
+        const QVert *a = &qs.verts[t->v[0]], *b = &qs.verts[t->v[1]], *c = &qs.verts[t->v[2]];
+        Vec3 pa = v3(a->x, a->y, a->z);
+        t->n = normalize(cross(sub(v3(b->x, b->y, b->z), pa), sub(v3(c->x, c->y, c->z), pa)));
+        for (int j = 0; j < 3; j++)
+            quadric_plane(qs.verts[t->v[j]].q, t->n.x, t->n.y, t->n.z, -dot(t->n, pa));
+    }
+    for (int i = 0; i < qs.num_tris; i++) qs_tri_errors(&qs.tris[i]);
+    return 0;
+}
+
+static void qs_free(void) {
+    free(qs.verts);
+    free(qs.tris);
+    free(qs.refs);
+    free(qs.flip0);
+    free(qs.flip1);
+    memset(&qs, 0, sizeof(qs));
+}
+
+/* Simplify src towards target triangles into dst. Positions are normalised
+ * to the unit sphere while simplifying so the error thresholds do not
+ * depend on model scale; dst keeps src's bounds so every level frames the
+ * same. Returns -1 if nothing was removed or memory runs out. */
+static int mesh_simplify(const Mesh *src, int target, Mesh *dst) {
+    double inv_r = src->radius > 1e-12 ? 1.0 / src->radius : 1.0;
+    qs.num_verts = src->num_verts;
+    qs.num_tris = src->num_tris;
+    qs.verts = calloc((size_t)qs.num_verts, sizeof(QVert));
+    qs.tris = calloc((size_t)qs.num_tris, sizeof(QTri));
+    if (!qs.verts || !qs.tris) {
+        qs_free();
+        return -1;
+    }
+    for (int i = 0; i < qs.num_verts; i++) {
+        qs.verts[i].x = (src->px[i] - src->center.x) * inv_r;
+        qs.verts[i].y = (src->py[i] - src->center.y) * inv_r;
+        qs.verts[i].z = (src->pz[i] - src->center.z) * inv_r;
+    }
+    for (int i = 0; i < qs.num_tris; i++) {
+        memcpy(qs.tris[i].v, src->idx + i * 3, sizeof(qs.tris[i].v));
+        qs.tris[i].color = src->colors[i];
+    }
+
+    int removed = 0;
+    for (int pass = 0; pass < 100 && qs.num_tris - removed > target; pass++) {
+        if (pass % 5 == 0) {
+            if (qs_rebuild(pass == 0) < 0) {
+                qs_free();
+                return -1;
+            }
+            removed = 0;
+        }
+        for (int i = 0; i < qs.num_tris; i++) qs.tris[i].dirty = 0;
+        double threshold = 1e-9 * pow(pass + 3, 7.0);
+        for (int i = 0; i < qs.num_tris && qs.num_tris - removed > target; i++) {
+            QTri *t = &qs.tris[i];
+            if (t->deleted || t->dirty || t->err[3] > threshold) continue;
+            for (int j = 0; j < 3; j++) {
+                if (t->err[j] > threshold) continue;
+                int i0 = t->v[j], i1 = t->v[(j + 1) % 3];
+                QVert *a = &qs.verts[i0], *b = &qs.verts[i1];
+                if (a->border != b->border) continue;
+                Vec3 p;
+                qs_edge_error(i0, i1, &p);
+                int need = a->tcount > b->tcount ? a->tcount : b->tcount;
+                if (need > qs.cap_flip) {
+                    qs.cap_flip = need * 2;
+                    free(qs.flip0);
+                    free(qs.flip1);
+                    qs.flip0 = malloc((size_t)qs.cap_flip);
+                    qs.flip1 = malloc((size_t)qs.cap_flip);
+                    if (!qs.flip0 || !qs.flip1) {
+                        qs_free();
+                        return -1;
+                    }
+                }
+                if (qs_flipped(p, i0, i1, qs.flip0) || qs_flipped(p, i1, i0, qs.flip1)) continue;
+                a->x = p.x; a->y = p.y; a->z = p.z;
+                for (int k = 0; k < 10; k++) a->q[k] += b->q[k];
+                int start = qs.num_refs;
+                int r0 = qs_retarget(i0, i0, qs.flip0);
+                int r1 = r0 < 0 ? -1 : qs_retarget(i0, i1, qs.flip1);
+                if (r1 < 0) {
+                    qs_free();
+                    return -1;
+                }
+                removed += r0 + r1;
+                a = &qs.verts[i0];
+                int count = qs.num_refs - start;
+                if (count <= a->tcount) {
+                    if (count) memmove(qs.refs + a->tstart, qs.refs + start, (size_t)count * sizeof(QRef));
+                } else {
+                    a->tstart = start;
+                }
+                a->tcount = count;
+                break;
+            }
+        }
+    }
+    int *remap = qs_rebuild(0) < 0 ? NULL : malloc((size_t)qs.num_verts * sizeof(int));
+    if (!remap) {
+        qs_free();
+        return -1;
+    }
+    int nv = 0, ok = qs.num_tris < src->num_tris;
+    for (int i = 0; i < qs.num_verts; i++) remap[i] = -1;
+    for (int i = 0; i < qs.num_tris; i++)
+        for (int j = 0; j < 3; j++)
+            if (remap[qs.tris[i].v[j]] < 0) remap[qs.tris[i].v[j]] = nv++;
+    if (ok && mesh_alloc(dst, nv, qs.num_tris) == 0) {
+        for (int i = 0; i < qs.num_verts; i++) {
+            if (remap[i] < 0) continue;
+            dst->px[remap[i]] = (float)(qs.verts[i].x * src->radius + src->center.x);
+            dst->py[remap[i]] = (float)(qs.verts[i].y * src->radius + src->center.y);
+            dst->pz[remap[i]] = (float)(qs.verts[i].z * src->radius + src->center.z);
+        }
+        for (int i = 0; i < qs.num_tris; i++) {
+            for (int j = 0; j < 3; j++) dst->idx[i * 3 + j] = remap[qs.tris[i].v[j]];
+            dst->colors[i] = qs.tris[i].color;
+        }
+        if (mesh_finish(dst, 1) == 0) {
+            dst->center = src->center;
+            dst->radius = src->radius;
+        } else {
+            ok = 0;
+        }
+    } else {
+        ok = 0;
+    }
+    free(remap);
+    qs_free();
+    return ok ? 0 : -1;
+}
+
+/* Each level has about a quarter of the triangles of the one before, down
+ * to LOD_MIN_TRIS. level[0] is the loaded mesh itself. */
+#define LOD_MAX 8
+#define LOD_MIN_TRIS 256
+#define LOD_TRIS_PER_SAMPLE 1.0
+
+typedef struct {
+    const Mesh *level[LOD_MAX];
+    Mesh own[LOD_MAX];
+    int count;
+    int built;              /* levels past the base simplified or baked */
+} LodChain;
+
+static LodChain scene_lod;
+static int lod_enabled = 1;
+
+/* A chain of just the base mesh, until lod_build() or a cache fills it in. */
+static void lod_init(LodChain *c, const Mesh *base) {
+    memset(c, 0, sizeof(*c));
+    c->level[0] = base;
+    c->count = 1;
+}
+
+static void lod_build(LodChain *c, const Mesh *base) {
+    lod_init(c, base);
+    c->built = 1;
+    while (c->count < LOD_MAX) {
+        const Mesh *prev = c->level[c->count - 1];
+        if (prev->num_tris / 4 < LOD_MIN_TRIS) break;
+        Mesh *next = &c->own[c->count];
+        /* A level that cannot be simplified, or runs out of memory, ends
+         * the chain at the levels already built. */
+        if (mesh_simplify(prev, prev->num_tris / 4, next) < 0) break;
+        /* Pinned borders can stall the collapse; a level that barely
+         * shrinks is not worth selecting. */
+        if (next->num_tris > prev->num_tris / 2) {
+            mesh_free(next);
+            break;
+        }
+        c->level[c->count] = next;
+        c->count++;
+    }
+}
+
+static void lod_free(LodChain *c) {
+    for (int i = 1; i < c->count; i++) mesh_free(&c->own[i]);
+    memset(c, 0, sizeof(*c));
+}
+
+/* Box UVs on the simplified levels; level 0 belongs to the caller. */
+static int lod_box_uv(LodChain *c) {
+    for (int i = 1; i < c->count; i++)
+        if (mesh_box_uv(&c->own[i]) < 0) return -1;
+    return 0;
+}
+
+/* Simplification costs seconds on large models, so it waits until LOD is
+ * first wanted; runs without it, and baked caches, never pay for it. New
+ * levels get box UVs when textures are loaded, or are dropped if they
+ * cannot. */
+static void lod_ensure(LodChain *c) {
+    if (c->built) return;
+    lod_build(c, c->level[0]);
+    if (num_textures && lod_box_uv(c) < 0) {
+        const Mesh *base = c->level[0];
+        lod_free(c);
+        lod_init(c, base);
+        c->built = 1;
+    }
+}
+
+/* Coarsest level that still has about LOD_TRIS_PER_SAMPLE triangles per
+ * sample of the bounding sphere's projected disc, r samples across;
+ * lod_select() takes radius and w in view space. */
+static const Mesh *lod_select_px(const LodChain *c, double r) {
+    double budget = LOD_TRIS_PER_SAMPLE * PI * r * r;
+    int l = 0;
+    while (l + 1 < c->count && c->level[l + 1]->num_tris >= budget) l++;
+    return c->level[l];
+}
+
+static const Mesh *lod_select(const LodChain *c, double radius, double w) {
+    if (!lod_enabled || c->count < 2 || w < NEAR_W) return c->level[0];
+    return lod_select_px(c, proj_scale() * radius / w);
+}
+
+/* ---- baked mesh cache ----
+ * A versioned image of a finished Mesh and its level-of-detail chain, in the
+ * writer's byte order: header, then per level SoA positions, SoA normals,
+ * indices, face colours and edge adjacency, each starting on a MESH_ALIGN
+ * boundary. Loading maps the file and points every level straight into it,
+ * so nothing is parsed, copied or simplified; a cache baked on a machine of
+ * the other byte order is refused rather than swapped, and has to be baked
+ * again from the model. */
+
+#define MESH_MAGIC "CUBEMSH"
+#define MESH_VERSION 3u
+#define MESH_ALIGN 64u
+#define MESH_BYTE_ORDER 0x01020304u     /* reads back swapped across byte orders */
+
+typedef struct {
+    uint32_t num_verts, num_tris, num_edges, reserved;
+    uint64_t off_pos, off_norm, off_idx, off_colors, off_edges;
+} MeshFileLevel;
+
+/* Every level keeps the base mesh's bounding sphere, so it is stored once. */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t byte_order, num_levels;
+    double center[3], radius;
+    MeshFileLevel level[LOD_MAX];
+    uint64_t file_size;
+} MeshFileHeader;
+
+_Static_assert(sizeof(Edge) == 4 * sizeof(int32_t), "Edge is stored verbatim in mesh caches");
+
+static inline uint64_t mesh_align(uint64_t off) {
+    return (off + MESH_ALIGN - 1) & ~(uint64_t)(MESH_ALIGN - 1);
+}
+
+static int write_padded(FILE *f, const void *data, uint64_t size, uint64_t *off) {
+    static const char zero[MESH_ALIGN];
+    uint64_t pad = mesh_align(*off) - *off;
+    if (pad && fwrite(zero, 1, (size_t)pad, f) != pad) return -1;
+    if (size && fwrite(data, 1, (size_t)size, f) != size) return -1;
+    *off += pad + size;
+    return 0;
+}
+
+static int mesh_save(const LodChain *c, const char *path) {
+    const Mesh *base = c->level[0];
+    MeshFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+    h.version = MESH_VERSION;
+    h.header_size = sizeof(h);
+    h.byte_order = MESH_BYTE_ORDER;
+    h.num_levels = (uint32_t)c->count;
+    h.center[0] = base->center.x;
+    h.center[1] = base->center.y;
+    h.center[2] = base->center.z;
+    h.radius = base->radius;
+    uint64_t end = sizeof(h);
+    for (int l = 0; l < c->count; l++) {
+        const Mesh *m = c->level[l];
+        MeshFileLevel *fl = &h.level[l];
+        uint64_t nv = (uint64_t)m->num_verts, nt = (uint64_t)m->num_tris;
+        fl->num_verts = (uint32_t)m->num_verts;
+        fl->num_tris = (uint32_t)m->num_tris;
+        fl->num_edges = (uint32_t)m->num_edges;
+        fl->off_pos = mesh_align(end);
+        fl->off_norm = mesh_align(fl->off_pos + nv * 3 * sizeof(float));
+        fl->off_idx = mesh_align(fl->off_norm + nv * 3 * sizeof(float));
+        fl->off_colors = mesh_align(fl->off_idx + nt * 3 * sizeof(int32_t));
+        fl->off_edges = mesh_align(fl->off_colors + nt * sizeof(Color));
+        end = fl->off_edges + (uint64_t)m->num_edges * sizeof(Edge);
+    }
+    h.file_size = end;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    uint64_t off = 0;
+    int r = write_padded(f, &h, sizeof(h), &off);
+    for (int l = 0; l < c->count && !r; l++) {
+        const Mesh *m = c->level[l];
+        uint64_t nv = (uint64_t)m->num_verts, nt = (uint64_t)m->num_tris;
+        /* Every Mesh keeps its SoA planes contiguous (px | py | pz). */
+        r = write_padded(f, m->px, nv * 3 * sizeof(float), &off);
+        if (!r) r = write_padded(f, m->nx, nv * 3 * sizeof(float), &off);
+        if (!r) r = write_padded(f, m->idx, nt * 3 * sizeof(int32_t), &off);
+        if (!r) r = write_padded(f, m->colors, nt * sizeof(Color), &off);
+        if (!r) r = write_padded(f, m->edges, (uint64_t)m->num_edges * sizeof(Edge), &off);
+    }
+    if (fclose(f) != 0) r = -1;
+    return r;
+}
+
+/* Points m at one level of a mapped cache after structural and index range
+ * checks, so a damaged cache fails to load instead of sending the rasterizer
+ * out of bounds. */
+static int load_cache_level(const char *data, size_t size, const MeshFileHeader *h, const MeshFileLevel *fl,
+                            Mesh *m) {
+    if (!fl->num_verts || !fl->num_tris || fl->num_verts > INT32_MAX / 3 || fl->num_tris > INT32_MAX / 3 ||
+        fl->num_edges > INT32_MAX)
+        return -1;
+    uint64_t nv = fl->num_verts, nt = fl->num_tris;
+    if (fl->off_pos % MESH_ALIGN || fl->off_norm % MESH_ALIGN || fl->off_idx % MESH_ALIGN ||
+        fl->off_colors % MESH_ALIGN || fl->off_edges % MESH_ALIGN ||
+        fl->off_pos < sizeof(*h) ||
+        fl->off_norm < fl->off_pos + nv * 3 * sizeof(float) ||
+        fl->off_idx < fl->off_norm + nv * 3 * sizeof(float) ||
+        fl->off_colors < fl->off_idx + nt * 3 * sizeof(int32_t) ||
+        fl->off_edges < fl->off_colors + nt * sizeof(Color) ||
+        size < fl->off_edges + (uint64_t)fl->num_edges * sizeof(Edge))
+        return -1;
+
+    memset(m, 0, sizeof(*m));
+    m->num_verts = (int)fl->num_verts;
+    m->num_tris = (int)fl->num_tris;
+    m->num_edges = (int)fl->num_edges;
+    m->px = (float *)(data + fl->off_pos);
+    m->py = m->px + nv;
+    m->pz = m->py + nv;
+    m->nx = (float *)(data + fl->off_norm);
+    m->ny = m->nx + nv;
+    m->nz = m->ny + nv;
+    m->idx = (int *)(data + fl->off_idx);
+    m->colors = (Color *)(data + fl->off_colors);
+    m->edges = (Edge *)(data + fl->off_edges);
+    m->center = v3(h->center[0], h->center[1], h->center[2]);
+    m->radius = h->radius;
+
+    for (uint64_t i = 0; i < nt * 3; i++)
+        if ((uint32_t)m->idx[i] >= fl->num_verts) return -1;
+    for (int e = 0; e < m->num_edges; e++) {
+        const Edge *ed = &m->edges[e];
+        if ((uint32_t)ed->v0 >= fl->num_verts || (uint32_t)ed->v1 >= fl->num_verts ||
+            (uint32_t)ed->f0 >= fl->num_tris || (ed->f1 != -1 && (uint32_t)ed->f1 >= fl->num_tris))
+            return -1;
+    }
+    m->map = (void *)data;
+    return 0;
+}
+
+/* The base level goes into m, which owns the mapping; the others go into
+ * lod as its own levels, borrowing it. */
+static int load_mesh_cache(const char *data, size_t size, Mesh *m, LodChain *lod) {
+    MeshFileHeader h;
+    if (size < sizeof(h)) return -1;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, MESH_MAGIC, sizeof(MESH_MAGIC)) || h.version != MESH_VERSION ||
+        h.byte_order != MESH_BYTE_ORDER || h.header_size != sizeof(h) || h.file_size != size ||
+        h.num_levels < 1 || h.num_levels > LOD_MAX)
+        return -1;
+    lod_init(lod, m);
+    if (load_cache_level(data, size, &h, &h.level[0], m) < 0) return -1;
+    m->map_size = size;
+    for (uint32_t l = 1; l < h.num_levels; l++) {
+        if (load_cache_level(data, size, &h, &h.level[l], &lod->own[l]) < 0) {
+            lod_free(lod);
+            return -1;
+        }
+        lod->level[l] = &lod->own[l];
+        lod->count++;
+    }
+    lod->built = 1;
+    return 0;
+}
+
+/* Load a baked cache, OBJ or binary PLY model, chosen by the file's magic,
+ * into m with lod as its chain: a cache brings its baked levels and keeps
+ * its mapping alive, a text model is unmapped once parsed and leaves the
+ * chain at m alone for lod_ensure(). */
+static int mesh_load(const char *path, Mesh *m, LodChain *lod) {
+    const char *data;
+    size_t size;
+    if (map_file(path, &data, &size) < 0) return -1;
+    if (size >= sizeof(MESH_MAGIC) && !memcmp(data, MESH_MAGIC, sizeof(MESH_MAGIC))) {
+        if (load_mesh_cache(data, size, m, lod) == 0) return 0;
+        munmap((void *)data, size);
+        return -1;
+    }
+    int r = size >= 4 && !memcmp(data, "ply", 3) ? load_ply(data, size, m) : load_obj(data, size, m);
+    munmap((void *)data, size);
+    if (r == 0) lod_init(lod, m);
+    return r;
+}
+
+/* ---- draw order ----
+ * Two-pass LSD radix sort on view depth quantised to 16 bits over the
+ * batch's own range, linear in the item count. Opaque geometry goes
+ * nearest first so the depth test rejects hidden samples instead of
+ * overwriting them. Edge anti-aliasing blends fringes over what is already
+ * drawn, so with it on the order stays back to front. */
+static struct {
+    uint16_t *keys;         /* two halves for ping-pong */
+    int *items;
+    int cap;
+} radix_tmp;
+
+static inline int draw_front_to_back(void) {
+    return aa_mode != AA_EDGE;
+}
+
+/* Reorder items[0..n) by z[items[i]]; the sort is stable within a key.
+ * Without room for the keys the items keep their order: the depth test
+ * still resolves visibility, only overdraw and fringe blending suffer. */
+static void depth_sort(int *items, int n, const float *z) {
+    if (n < 2) return;
+    if (n > radix_tmp.cap) {
+        free(radix_tmp.keys);
+        free(radix_tmp.items);
+        radix_tmp.cap = 0;
+        radix_tmp.keys = malloc((size_t)n * 2 * sizeof(uint16_t));
+        radix_tmp.items = malloc((size_t)n * sizeof(int));
+        if (!radix_tmp.keys || !radix_tmp.items) {
+            free(radix_tmp.keys);
+            free(radix_tmp.items);
+            radix_tmp.keys = NULL;
+            radix_tmp.items = NULL;
+            return;
+        }
+        radix_tmp.cap = n;
+    }
+    float lo = z[items[0]], hi = lo;
+    for (int i = 1; i < n; i++) {
+        lo = fminf(lo, z[items[i]]);
+        hi = fmaxf(hi, z[items[i]]);
+    }
+    float s = hi > lo ? 65535.0f / (hi - lo) : 0.0f;
+    int near_first = draw_front_to_back();
+    uint16_t *keys = radix_tmp.keys, *tkeys = keys + n;
+    int *titems = radix_tmp.items;
+    for (int i = 0; i < n; i++) {
+        float zi = z[items[i]];
+        keys[i] = (uint16_t)((near_first ? hi - zi : zi - lo) * s);
+    }
+    /* Small batches (a cube's faces) are cheaper to insert than to bucket. */
+    if (n <= 32) {
+        for (int i = 1; i < n; i++) {
+            uint16_t k = keys[i];
+            int it = items[i], j = i;
+            for (; j > 0 && keys[j - 1] > k; j--) {
+                keys[j] = keys[j - 1];
+                items[j] = items[j - 1];
+            }
+            keys[j] = k;
+            items[j] = it;
+        }
+        return;
+    }
+    for (int shift = 0; shift < 16; shift += 8) {
+        int count[257] = {0};
+        for (int i = 0; i < n; i++) count[((keys[i] >> shift) & 0xFF) + 1]++;
+        for (int b = 0; b < 256; b++) count[b + 1] += count[b];
+        for (int i = 0; i < n; i++) {
+            int d = count[(keys[i] >> shift) & 0xFF]++;
+            tkeys[d] = keys[i];
+            titems[d] = items[i];
+        }
+        uint16_t *kt = keys; keys = tkeys; tkeys = kt;
+        int *it = items; items = titems; titems = it;
+    }
+}
+
+/* Per-frame working arrays, grown to the largest mesh seen. */
+static struct {
+    int verts, tris;
+    float *vx, *vy, *vz;    /* view space */
+    float *sx, *sy;         /* screen space, valid where the outcode has no CLIP_NEAR */
+    float *vnx, *vny, *vnz, *vl;    /* Gouraud: view-space vertex normal, brightness, */
+    float *vk;                      /* and its key-light share */
+    uint16_t *oc;
+    int *faces;             /* triangle index per visible face */
+    float *fnx, *fny, *fnz; /* per visible face: view-space unit normal, */
+    float *fcx, *fcy, *fcz; /* centre (fcz doubles as the sort depth) */
+    float *light, *key;     /* and brightness with its key-light share */
+    int *order;
+    uint8_t *front;
+} scratch;
+
+/* Grows the per-mesh buffers; a group that cannot grow is freed and left
+ * empty, and the caller skips the mesh. */
+static int scratch_reserve(int verts, int tris) {
+    if (verts > scratch.verts) {
+        free(scratch.vx);
+        free(scratch.oc);
+        scratch.verts = 0;
+        scratch.vx = alloc_aligned((size_t)verts * 10 * sizeof(float));
+        scratch.oc = malloc((size_t)verts * sizeof(uint16_t));
+        if (!scratch.vx || !scratch.oc) {
+            free(scratch.vx);
+            free(scratch.oc);
+            scratch.vx = NULL;
+            scratch.oc = NULL;
+            return -1;
+        }
+        scratch.vy = scratch.vx + verts;
+        scratch.vz = scratch.vy + verts;
+        scratch.sx = scratch.vz + verts;
+        scratch.sy = scratch.sx + verts;
+        scratch.vnx = scratch.sy + verts;
+        scratch.vny = scratch.vnx + verts;
+        scratch.vnz = scratch.vny + verts;
+        scratch.vl = scratch.vnz + verts;
+        scratch.vk = scratch.vl + verts;
+        scratch.verts = verts;
+    }
+    if (tris > scratch.tris) {
+        free(scratch.faces);
+        free(scratch.fnx);
+        free(scratch.order);
+        free(scratch.front);
+        scratch.tris = 0;
+        scratch.faces = malloc((size_t)tris * sizeof(int));
+        scratch.fnx = alloc_aligned((size_t)tris * 8 * sizeof(float));
+        scratch.order = malloc((size_t)tris * sizeof(int));
+        scratch.front = malloc((size_t)tris);
+        if (!scratch.faces || !scratch.fnx || !scratch.order || !scratch.front) {
+            free(scratch.faces);
+            free(scratch.fnx);
+            free(scratch.order);
+            free(scratch.front);
+            scratch.faces = scratch.order = NULL;
+            scratch.fnx = NULL;
+            scratch.front = NULL;
+            return -1;
+        }
+        scratch.fny = scratch.fnx + tris;
+        scratch.fnz = scratch.fny + tris;
+        scratch.fcx = scratch.fnz + tris;
+        scratch.fcy = scratch.fcx + tris;
+        scratch.fcz = scratch.fcy + tris;
+        scratch.light = scratch.fcz + tris;
+        scratch.key = scratch.light + tris;
+        scratch.tris = tris;
+    }
+    return 0;
+}
+
+/* alpha below 1 draws the mesh translucent: both faces of every triangle,
+ * unsorted, through the OIT planes. */
+static void render_mesh(const Mesh *m, const Mat4 *model_view, Color tint, double alpha) {
+    int translucent = alpha < 1.0;
+    int white = tint.r == 255 && tint.g == 255 && tint.b == 255;
+    if (scratch_reserve(m->num_verts, m->num_tris) < 0) return;
+    Mat4f mv = mat4f_from(model_view);
+    soa_transform_points(&mv, m->px, m->py, m->pz, scratch.vx, scratch.vy, scratch.vz, m->num_verts);
+    const float *vx = scratch.vx, *vy = scratch.vy, *vz = scratch.vz;
+#define VIEW_POS(i) v3(vx[i], vy[i], vz[i])
+
+    /* Post-transform cache: each shared vertex is projected and classified
+     * once per frame, triangles just index into it. */
+    const float *sx = scratch.sx, *sy = scratch.sy;
+    const uint16_t *oc = scratch.oc;
+    soa_project(vx, vy, vz, scratch.sx, scratch.sy, m->num_verts);
+    soa_outcodes(vx, vy, vz, scratch.oc, m->num_verts);
+
+    /* Gouraud lights vertices instead of faces: normals go through the
+     * model-view 3x3 (rotation and uniform scale) and are renormalised. */
+    int smooth = shade_mode == SHADE_GOURAUD;
+    int shadowed = shadow_enabled && shadow.depth;
+    const float *vl = scratch.vl, *vk = scratch.vk;
+    if (smooth) {
+        Mat4 rot = *model_view;
+        rot.m[0][3] = rot.m[1][3] = rot.m[2][3] = 0;
+        Mat4f nm = mat4f_from(&rot);
+        soa_transform_points(&nm, m->nx, m->ny, m->nz, scratch.vnx, scratch.vny, scratch.vnz, m->num_verts);
+        soa_normalize(scratch.vnx, scratch.vny, scratch.vnz, m->num_verts);
+        soa_light(scratch.vnx, scratch.vny, scratch.vnz, vx, vy, vz, scratch.vl,
+                  shadowed ? scratch.vk : NULL, m->num_verts);
+    }
+
+    /* Textured faces take the texel colour in place of the face colour,
+     * tinted the same way. */
+    int textured = m->uv && num_textures && texture_enabled;
+    int *faces = scratch.faces;
+    uint8_t *front = scratch.front;
+    int num_vis = 0;
+
+    for (int i = 0; i < m->num_tris; i++) {
+        const int *f = m->idx + i * 3;
+        Vec3 v0 = VIEW_POS(f[0]), v1 = VIEW_POS(f[1]), v2 = VIEW_POS(f[2]);
+
+        Vec3 edge1 = sub(v1, v0);
+        Vec3 edge2 = sub(v2, v0);
+        Vec3 normal = normalize(cross(edge1, edge2));
+
+        Vec3 center = scale(add(add(v0, v1), v2), 1.0 / 3.0);
+
+        front[i] = dot(normal, scale(center, -1.0)) > 0;
+        if (front[i] || translucent) {
+            if (!front[i]) normal = scale(normal, -1.0);
+            faces[num_vis] = i;
+            scratch.fnx[num_vis] = (float)normal.x;
+            scratch.fny[num_vis] = (float)normal.y;
+            scratch.fnz[num_vis] = (float)normal.z;
+            scratch.fcx[num_vis] = (float)center.x;
+            scratch.fcy[num_vis] = (float)center.y;
+            scratch.fcz[num_vis] = (float)center.z;
+            scratch.order[num_vis] = num_vis;
+            num_vis++;
+        }
+    }
+    if (!smooth)
+        soa_light(scratch.fnx, scratch.fny, scratch.fnz, scratch.fcx, scratch.fcy, scratch.fcz,
+                  scratch.light, shadowed ? scratch.key : NULL, num_vis);
+
+    if (!translucent) depth_sort(scratch.order, num_vis, scratch.fcz);
+    frame_stats.tris += m->num_tris;
+
+    for (int f = 0; f < num_vis; f++) {
+        int vis = scratch.order[f], idx = faces[vis];
+        const int *tri = m->idx + idx * 3;
+        int c0 = oc[tri[0]], c1 = oc[tri[1]], c2 = oc[tri[2]];
+        if (c0 & c1 & c2 & CLIP_REJECT) continue;
+        Color base = white ? m->colors[idx] : tint_color(m->colors[idx], tint);
+        TriPaint paint = {.smooth = smooth, .shadow = shadowed, .oit = translucent, .alpha = alpha};
+        if (shadowed) {
+            paint.base = base;
+            for (int k = 0; k < 3; k++) {
+                paint.light[k] = smooth ? vl[tri[k]] : scratch.light[vis];
+                paint.key[k] = smooth ? vk[tri[k]] : scratch.key[vis];
+            }
+        }
+        if (textured) {
+            paint.tex = &textures[m->tex[idx] % num_textures];
+            paint.tinted = !white;
+            paint.tint = tint;
+            for (int k = 0; k < 3; k++) {
+                paint.light[k] = smooth ? vl[tri[k]] : scratch.light[vis];
+                paint.u[k] = m->uv[idx * 6 + k * 2];
+                paint.v[k] = m->uv[idx * 6 + k * 2 + 1];
+            }
+        } else if (smooth) {
+            paint.base = base;
+            for (int k = 0; k < 3; k++) paint.light[k] = vl[tri[k]];
+        } else {
+            paint.flat = shade(base, scratch.light[vis]);
+        }
+        int need = (c0 | c1 | c2) & CLIP_MUST;
+        frame_stats.tris_drawn++;
+        if (!need) {
+            raster_tri(v3(sx[tri[0]], sy[tri[0]], vz[tri[0]]),
+                       v3(sx[tri[1]], sy[tri[1]], vz[tri[1]]),
+                       v3(sx[tri[2]], sy[tri[2]], vz[tri[2]]), &paint);
+        } else {
+            ClipVert poly[3 + 6];
+            for (int k = 0; k < 3; k++) {
+                poly[k] = to_clip(VIEW_POS(tri[k]));
+                poly[k].l = paint.light[k];
+                poly[k].k = paint.key[k];
+                poly[k].u = paint.u[k];
+                poly[k].v = paint.v[k];
+            }
+            clip_raster(poly, need, &paint);
+        }
+    }
+    if (!draw_outline) return;
+    for (int e = 0; e < m->num_edges; e++) {
+        const Edge *ed = &m->edges[e];
+        if (front[ed->f0] != (ed->f1 >= 0 && front[ed->f1]))
+            draw_line(VIEW_POS(ed->v0), VIEW_POS(ed->v1), rgb(255,255,255));
+    }
+#undef VIEW_POS
+}
+
+/* Bounding-sphere frustum test for SoA view-space centres: out[i] = 1 when
+ * sphere i may touch the viewport between the near and far planes. Side
+ * planes are the clip-space viewport planes rewritten in view space and
+ * normalised, so the test is a plain signed distance against -r. */
+static void soa_cull_spheres(const float *x, const float *y, const float *z, const float *r,
+                             uint8_t *out, int n) {
+    float s = (float)proj_scale();
+    float hx = (float)(buf.width * 0.5), hy = (float)buf.height;
+    float ix = 1.0f / sqrtf(s * s + hx * hx), iy = 1.0f / sqrtf(s * s + hy * hy);
+    /* dist_left = (s*x - hx*z) * ix, dist_right = (-s*x - hx*z) * ix, likewise for y. */
+    float ax = s * ix, bx = hx * ix, ay = s * iy, by = hy * iy;
+    int i = 0;
+#if defined(__AVX__)
+    const __m256 vax = _mm256_set1_ps(ax), vbx = _mm256_set1_ps(bx);
+    const __m256 vay = _mm256_set1_ps(ay), vby = _mm256_set1_ps(by);
+    const __m256 near_w = _mm256_set1_ps((float)NEAR_W), far_w = _mm256_set1_ps((float)FAR_W);
+    for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i);
+        __m256 w = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(z + i));
+        __m256 vr = _mm256_loadu_ps(r + i), nr = _mm256_sub_ps(_mm256_setzero_ps(), vr);
+        __m256 px = _mm256_mul_ps(vax, vx), py = _mm256_mul_ps(vay, vy);
+        __m256 wx = _mm256_mul_ps(vbx, w), wy = _mm256_mul_ps(vby, w);
+        __m256 ok = _mm256_cmp_ps(_mm256_add_ps(w, vr), near_w, _CMP_GE_OQ);
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_sub_ps(w, vr), far_w, _CMP_LE_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(px, wx), nr, _CMP_GE_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_sub_ps(wx, px), nr, _CMP_GE_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_sub_ps(wy, py), nr, _CMP_GE_OQ));
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(_mm256_add_ps(py, wy), nr, _CMP_GE_OQ));
+        int mask = _mm256_movemask_ps(ok);
+        for (int k = 0; k < 8; k++) out[i + k] = (uint8_t)((mask >> k) & 1);
+    }
+#endif
+    for (; i < n; i++) {
+        float w = -z[i], px = ax * x[i], py = ay * y[i], wx = bx * w, wy = by * w;
+        out[i] = (uint8_t)(w + r[i] >= (float)NEAR_W && w - r[i] <= (float)FAR_W &&
+                           px + wx >= -r[i] && wx - px >= -r[i] &&
+                           wy - py >= -r[i] && py + wy >= -r[i]);
+    }
+}
+
+static void instances_free(Instances *in) {
+    free(in->x);
+    free(in->visible);
+    free(in->list);
+    free(in->tint);
+    memset(in, 0, sizeof(*in));
+}
+
+static int instances_alloc(Instances *in, int count) {
+    memset(in, 0, sizeof(*in));
+    in->x = alloc_aligned((size_t)count * 10 * sizeof(float));
+    in->visible = malloc((size_t)count);
+    in->list = malloc((size_t)count * sizeof(int));
+    in->tint = malloc((size_t)count * sizeof(Color));
+    if (!in->x || !in->visible || !in->list || !in->tint) {
+        instances_free(in);
+        return -1;
+    }
+    in->count = count;
+    in->y = in->x + count;
+    in->z = in->y + count;
+    in->scale = in->z + count;
+    in->y0 = in->scale + count;
+    in->vx = in->y0 + count;
+    in->vy = in->vx + count;
+    in->vz = in->vy + count;
+    in->vr = in->vz + count;
+    in->alpha = in->vr + count;
+    return 0;
+}
+
+/* Stress scene: an n x n x n lattice of the scene mesh, tinted by position,
+ * rotating as a whole while every instance spins in place. Alternate
+ * instances, in a 3D checkerboard, are the translucent ones. Returns -1
+ * if the instances cannot be allocated. */
+static int instances_init_lattice(Instances *in, int n) {
+    if (instances_alloc(in, n * n * n) < 0) return -1;
+    double spacing = 2.5, half = (n - 1) * spacing * 0.5;
+    int i = 0;
+    for (int a = 0; a < n; a++) {
+        for (int b = 0; b < n; b++) {
+            for (int c = 0; c < n; c++, i++) {
+                in->x[i] = (float)(a * spacing - half);
+                in->y[i] = in->y0[i] = (float)(b * spacing - half);
+                in->z[i] = (float)(c * spacing - half);
+                in->scale[i] = 0.8f;
+                in->alpha[i] = (a + b + c) % 2 ? (float)translucent_alpha : 1.0f;
+                double d = n > 1 ? 1.0 / (n - 1) : 0.0;
+                in->tint[i] = rgb((uint8_t)(80 + 175 * a * d), (uint8_t)(80 + 175 * b * d),
+                                  (uint8_t)(80 + 175 * c * d));
+            }
+        }
+    }
+    view_dist = half * 2.2 + 5.0;
+    return 0;
+}
+
+/* ---- instance BVH ----
+ * Nodes are laid out depth-first: an inner node's left child is the next
+ * node and its right child is at first. Leaves cover items[first..+count).
+ * Because children always follow their parent, a reverse sweep refits the
+ * whole tree bottom-up without rebuilding it. */
+
+#define BVH_LEAF_SIZE 4
+
+static inline void instance_bounds(const Instances *in, int i, float *lo, float *hi) {
+    float r = (float)sqrt(3.0) * in->scale[i];
+    lo[0] = in->x[i] - r; hi[0] = in->x[i] + r;
+    lo[1] = in->y[i] - r; hi[1] = in->y[i] + r;
+    lo[2] = in->z[i] - r; hi[2] = in->z[i] + r;
+}
+
+static void bvh_node_bounds(Bvh *b, const Instances *in, int node) {
+    BvhNode *n = &b->nodes[node];
+    if (n->count) {
+        for (int k = 0; k < 3; k++) { n->lo[k] = 1e30f; n->hi[k] = -1e30f; }
+        for (int j = n->first; j < n->first + n->count; j++) {
+            float lo[3], hi[3];
+            instance_bounds(in, b->items[j], lo, hi);
+            for (int k = 0; k < 3; k++) {
+                n->lo[k] = fminf(n->lo[k], lo[k]);
+                n->hi[k] = fmaxf(n->hi[k], hi[k]);
+            }
+        }
+    } else {
+        const BvhNode *l = &b->nodes[node + 1], *r = &b->nodes[n->first];
+        for (int k = 0; k < 3; k++) {
+            n->lo[k] = fminf(l->lo[k], r->lo[k]);
+            n->hi[k] = fmaxf(l->hi[k], r->hi[k]);
+        }
+    }
+}
+
+static inline float instance_centre(const Instances *in, int i, int axis) {
+    return axis == 0 ? in->x[i] : (axis == 1 ? in->y[i] : in->z[i]);
+}
+
+/* Quickselect items[lo..hi) so the median along axis lands at mid. */
+static void bvh_select(int *items, int lo, int hi, int mid, const Instances *in, int axis) {
+    while (hi - lo > 1) {
+        float pivot = instance_centre(in, items[(lo + hi) / 2], axis);
+        int i = lo, j = hi - 1;
+        while (i <= j) {
+            while (instance_centre(in, items[i], axis) < pivot) i++;
+            while (instance_centre(in, items[j], axis) > pivot) j--;
+            if (i <= j) { int t = items[i]; items[i] = items[j]; items[j] = t; i++; j--; }
+        }
+        if (mid <= j) hi = j + 1;
+        else if (mid >= i) lo = i;
+        else return;
+    }
+}
+
+static int bvh_build_node(Bvh *b, const Instances *in, int first, int count) {
+    int node = b->num_nodes++;
+    BvhNode *n = &b->nodes[node];
+    if (count <= BVH_LEAF_SIZE) {
+        n->first = first;
+        n->count = count;
+        bvh_node_bounds(b, in, node);
+        return node;
+    }
+    float clo[3] = {1e30f, 1e30f, 1e30f}, chi[3] = {-1e30f, -1e30f, -1e30f};
+    for (int j = first; j < first + count; j++) {
+        for (int k = 0; k < 3; k++) {
+            float c = instance_centre(in, b->items[j], k);
+            clo[k] = fminf(clo[k], c);
+            chi[k] = fmaxf(chi[k], c);
+        }
+    }
+    int axis = 0;
+    for (int k = 1; k < 3; k++) if (chi[k] - clo[k] > chi[axis] - clo[axis]) axis = k;
+    int half = count / 2;
+    bvh_select(b->items, first, first + count, first + half, in, axis);
+    n->count = 0;
+    bvh_build_node(b, in, first, half);
+    int right = bvh_build_node(b, in, first + half, count - half);
+    b->nodes[node].first = right;
+    bvh_node_bounds(b, in, node);
+    return node;
+}
+
+static void bvh_free(Bvh *b) {
+    free(b->nodes);
+    free(b->items);
+    memset(b, 0, sizeof(*b));
+}
+
+static int bvh_build(Bvh *b, const Instances *in) {
+    bvh_free(b);
+    if (!in->count) return 0;
+    b->nodes = malloc((size_t)(2 * in->count) * sizeof(BvhNode));
+    b->items = malloc((size_t)in->count * sizeof(int));
+    if (!b->nodes || !b->items) {
+        bvh_free(b);
+        return -1;
+    }
+    for (int i = 0; i < in->count; i++) b->items[i] = i;
+    bvh_build_node(b, in, 0, in->count);
+    return 0;
+}
+
+/* Recompute bounds after instances moved; topology is kept. */
+static void bvh_refit(Bvh *b, const Instances *in) {
+    for (int node = b->num_nodes - 1; node >= 0; node--) bvh_node_bounds(b, in, node);
+}
+
+/* World-space frustum planes (a, b, c, d), inside where a*x + b*y + c*z + d >= 0:
+ * the view-space near, far and viewport planes pulled back through view. */
+static void frustum_planes(const Mat4 *view, double planes[6][4]) {
+    double s = proj_scale(), hx = buf.width * 0.5, hy = (double)buf.height;
+    double ix = 1.0 / sqrt(s * s + hx * hx), iy = 1.0 / sqrt(s * s + hy * hy);
+    double vp[6][4] = {
+        {0, 0, -1, -NEAR_W},
+        {0, 0, 1, FAR_W},
+        {s * ix, 0, -hx * ix, 0},
+        {-s * ix, 0, -hx * ix, 0},
+        {0, -s * iy, -hy * iy, 0},
+        {0, s * iy, -hy * iy, 0}
+    };
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 3; c++)
+            planes[p][c] = vp[p][0] * view->m[0][c] + vp[p][1] * view->m[1][c] + vp[p][2] * view->m[2][c];
+        planes[p][3] = vp[p][0] * view->m[0][3] + vp[p][1] * view->m[1][3] +
+                       vp[p][2] * view->m[2][3] + vp[p][3];
+    }
+}
+
+/* Collect instances whose node boxes intersect the frustum. A plane the
+ * box lies fully inside is dropped from the mask for the whole subtree, so
+ * a box inside all planes accepts everything below it without tests. */
+static int bvh_cull(const Bvh *b, double planes[6][4], int *out) {
+    struct { int node, mask; } stack[64];
+    int sp = 0, n = 0;
+    if (!b->num_nodes) return 0;
+    stack[sp].node = 0; stack[sp].mask = 0x3F; sp++;
+    while (sp) {
+        sp--;
+        int node = stack[sp].node, mask = stack[sp].mask;
+        const BvhNode *nd = &b->nodes[node];
+        double c[3], e[3];
+        for (int k = 0; k < 3; k++) {
+            c[k] = 0.5 * ((double)nd->lo[k] + nd->hi[k]);
+            e[k] = 0.5 * ((double)nd->hi[k] - nd->lo[k]);
+        }
+        int outside = 0;
+        for (int p = 0; p < 6 && !outside; p++) {
+            if (!(mask & (1 << p))) continue;
+            const double *pl = planes[p];
+            double d = pl[0] * c[0] + pl[1] * c[1] + pl[2] * c[2] + pl[3];
+            double r = fabs(pl[0]) * e[0] + fabs(pl[1]) * e[1] + fabs(pl[2]) * e[2];
+            if (d + r < 0) outside = 1;
+            else if (d - r >= 0) mask &= ~(1 << p);
+        }
+        if (outside) continue;
+        if (nd->count) {
+            for (int j = 0; j < nd->count; j++) out[n++] = b->items[nd->first + j];
+            continue;
+        }
+        stack[sp].node = nd->first; stack[sp].mask = mask; sp++;
+        stack[sp].node = node + 1; stack[sp].mask = mask; sp++;
+    }
+    return n;
+}
+
+/* Bob every instance on a wave so the hierarchy has something to refit. */
+static void instances_animate(Instances *in, Bvh *b) {
+    for (int i = 0; i < in->count; i++)
+        in->y[i] = in->y0[i] + 0.6f * sinf((float)time_global * 2.0f + 0.35f * (in->x[i] + in->z[i]));
+    if (b->num_nodes) bvh_refit(b, in);
+}
+
+/* Fill in->list with the instances that survive culling and their
+ * view-space centres in vx/vy/vz. */
+static int cull_instances(Instances *in, const Bvh *b, const Mat4 *view) {
+    int n = 0;
+    if (cull_mode == CULL_BVH && b->num_nodes) {
+        double planes[6][4];
+        frustum_planes(view, planes);
+        n = bvh_cull(b, planes, in->list);
+        for (int j = 0; j < n; j++) {
+            int i = in->list[j];
+            Vec3 c = mat4_point(view, v3(in->x[i], in->y[i], in->z[i]));
+            in->vx[i] = (float)c.x; in->vy[i] = (float)c.y; in->vz[i] = (float)c.z;
+        }
+        return n;
+    }
+    Mat4f viewf = mat4f_from(view);
+    double bound = sqrt(3.0);
+    soa_transform_points(&viewf, in->x, in->y, in->z, in->vx, in->vy, in->vz, in->count);
+    for (int i = 0; i < in->count; i++) in->vr[i] = (float)bound * in->scale[i];
+    soa_cull_spheres(in->vx, in->vy, in->vz, in->vr, in->visible, in->count);
+    for (int i = 0; i < in->count; i++) if (in->visible[i]) in->list[n++] = i;
+    return n;
+}
+
+/* One mesh, many placements. Instances share the view rotation and the
+ * local spin, so per-instance work is culling plus a centre transform;
+ * survivors are depth-ordered and reuse the shared 3x3 with their own scale
+ * and translation. */
+static Mat4 instances_local(const Mesh *m) {
+    return mat4_mul(mat4_euler(rot_x, rot_y, rot_z),
+                    mat4_mul(mat4_euler(time_global * 0.9, time_global * 1.3, 0), mesh_fit(m)));
+}
+
+/* The shared local transform scaled by s and moved to view-space centre c. */
+static Mat4 instance_model_view(const Mat4 *local, double s, Vec3 c) {
+    Mat4 mv = *local;
+    for (int r = 0; r < 3; r++)
+        for (int k = 0; k < 3; k++) mv.m[r][k] *= s;
+    mv.m[0][3] = c.x;
+    mv.m[1][3] = c.y;
+    mv.m[2][3] = c.z;
+    return mv;
+}
+
+static void render_instances(const LodChain *lod, Instances *in, Bvh *b) {
+    Mat4 view = mat4_mul(mat4_translate(0, 0, -view_dist), mat4_euler(rot_x, rot_y, rot_z));
+    Mat4 local = instances_local(lod->level[0]);
+    int n = cull_instances(in, b, &view);
+    depth_sort(in->list, n, in->vz);
+
+    /* Opaque instances first, so translucent ones test against all of them. */
+    for (int pass = 0; pass < 2; pass++) {
+        for (int j = 0; j < n; j++) {
+            int i = in->list[j];
+            double a = oit_enabled ? in->alpha[i] : 1.0;
+            if ((a < 1.0) != pass) continue;
+            double s = in->scale[i];
+            Mat4 mv = instance_model_view(&local, s, v3(in->vx[i], in->vy[i], in->vz[i]));
+            render_mesh(lod_select(lod, sqrt(3.0) * s, -in->vz[i]), &mv, in->tint[i], a);
+            frame_stats.instances++;
+        }
+    }
+}
+
+/* ---- voxel grid ----
+ * Occupancy is kept as 32-voxel x-rows, so a chunk row is one word and its
+ * hidden faces drop out of an and-not against the neighbouring row. Each
+ * chunk owns a mesh of greedily merged quads and is re-meshed only when one
+ * of its voxels, or a voxel on a face it shares with a neighbour, changes.
+ * Quads meet at T-junctions, so chunk meshes carry no edge adjacency and
+ * draw without the outline. */
+#define VOXEL_CHUNK 32
+#define VOXEL_BRUSH 6
+
+static const Color VOXEL_PALETTE[7] = {
+    {0,0,0},                /* empty */
+    {40,90,200},            /* water */
+    {220,200,120},          /* sand */
+    {70,170,60},            /* grass */
+    {120,110,100},          /* rock */
+    {240,240,250},          /* snow */
+    {255,0,128}             /* brush */
+};
+
+typedef struct { uint8_t dir, mat, slice, u, v, w, h; } VoxelQuad;
+
+static struct {
+    uint8_t mask[VOXEL_CHUNK][VOXEL_CHUNK][VOXEL_CHUNK];    /* [slice][v][u] */
+    VoxelQuad *quads;
+    int num_quads, cap_quads;
+} vscratch;
+
+static void voxels_free(VoxelGrid *g) {
+    int count = g->nc * g->nc * g->nc;
+    for (int i = 0; g->chunks && i < count; i++) mesh_free(&g->chunks[i]);
+    free(g->occ);
+    free(g->mat);
+    free(g->chunks);
+    free(g->dirty);
+    free(g->cx);
+    free(g->visible);
+    free(g->list);
+    free(vscratch.quads);
+    memset(&vscratch, 0, sizeof(vscratch));
+    memset(g, 0, sizeof(*g));
+}
+
+/* n must be a multiple of VOXEL_CHUNK. */
+static int voxels_init(VoxelGrid *g, int n) {
+    memset(g, 0, sizeof(*g));
+    g->n = n;
+    g->nc = n / VOXEL_CHUNK;
+    int count = g->nc * g->nc * g->nc;
+    size_t voxels = (size_t)(n * n * n);
+    g->occ = calloc(voxels / 32, sizeof(uint32_t));
+    g->mat = calloc(voxels, 1);
+    g->chunks = calloc((size_t)count, sizeof(Mesh));
+    g->dirty = calloc((size_t)count, 1);
+    g->cx = alloc_aligned((size_t)count * 7 * sizeof(float));
+    g->visible = malloc((size_t)count);
+    g->list = malloc((size_t)count * sizeof(int));
+    if (!g->occ || !g->mat || !g->chunks || !g->dirty || !g->cx || !g->visible || !g->list) {
+        voxels_free(g);
+        return -1;
+    }
+    g->cy = g->cx + count; g->cz = g->cy + count;
+    g->vx = g->cz + count; g->vy = g->vx + count; g->vz = g->vy + count;
+    g->vr = g->vz + count;
+    float r = (float)(VOXEL_CHUNK * 0.5 * sqrt(3.0) * 2.0 / n);
+    for (int cz = 0, i = 0; cz < g->nc; cz++)
+        for (int cy = 0; cy < g->nc; cy++)
+            for (int cx = 0; cx < g->nc; cx++, i++) {
+                g->cx[i] = ((float)cx + 0.5f) * VOXEL_CHUNK;
+                g->cy[i] = ((float)cy + 0.5f) * VOXEL_CHUNK;
+                g->cz[i] = ((float)cz + 0.5f) * VOXEL_CHUNK;
+                g->vr[i] = r;
+            }
+    return 0;
+}
+
+static inline uint32_t voxel_row(const VoxelGrid *g, int wx, int y, int z) {
+    if (wx < 0 || wx >= g->nc || y < 0 || y >= g->n || z < 0 || z >= g->n) return 0;
+    return g->occ[(z * g->n + y) * g->nc + wx];
+}
+
+static inline void voxel_mark(VoxelGrid *g, int cx, int cy, int cz) {
+    if (cx < 0 || cx >= g->nc || cy < 0 || cy >= g->nc || cz < 0 || cz >= g->nc) return;
+    g->dirty[(cz * g->nc + cy) * g->nc + cx] = 1;
+}
+
+static void voxel_set(VoxelGrid *g, int x, int y, int z, uint8_t m) {
+    if (x < 0 || x >= g->n || y < 0 || y >= g->n || z < 0 || z >= g->n) return;
+    int i = (z * g->n + y) * g->n + x;
+    if (g->mat[i] == m) return;
+    g->mat[i] = m;
+    uint32_t *w = &g->occ[(z * g->n + y) * g->nc + x / VOXEL_CHUNK];
+    uint32_t bit = 1u << (x % VOXEL_CHUNK);
+    *w = m ? *w | bit : *w & ~bit;
+    int c[3] = {x / VOXEL_CHUNK, y / VOXEL_CHUNK, z / VOXEL_CHUNK};
+    int l[3] = {x % VOXEL_CHUNK, y % VOXEL_CHUNK, z % VOXEL_CHUNK};
+    voxel_mark(g, c[0], c[1], c[2]);
+    for (int a = 0; a < 3; a++) {
+        int d = l[a] == 0 ? -1 : l[a] == VOXEL_CHUNK - 1 ? 1 : 0;
+        if (!d) continue;
+        int nb[3] = {c[0], c[1], c[2]};
+        nb[a] += d;
+        voxel_mark(g, nb[0], nb[1], nb[2]);
+    }
+}
+
+/* Voxels of row (wx, y, z) whose face in direction dir is exposed. dir is
+ * 2 * axis + (1 for the negative side); outside the grid counts as empty. */
+static inline uint32_t voxel_faces(const VoxelGrid *g, int dir, int wx, int y, int z) {
+    uint32_t w = voxel_row(g, wx, y, z);
+    switch (dir) {
+    case 0: return w & ~((w >> 1) | (voxel_row(g, wx + 1, y, z) << 31));
+    case 1: return w & ~((w << 1) | (voxel_row(g, wx - 1, y, z) >> 31));
+    case 2: return w & ~voxel_row(g, wx, y + 1, z);
+    case 3: return w & ~voxel_row(g, wx, y - 1, z);
+    case 4: return w & ~voxel_row(g, wx, y, z + 1);
+    default: return w & ~voxel_row(g, wx, y, z - 1);
+    }
+}
+
+static int voxel_push_quad(VoxelQuad q) {
+    if (vscratch.num_quads == vscratch.cap_quads) {
+        int cap = vscratch.cap_quads ? vscratch.cap_quads * 2 : 4096;
+        VoxelQuad *p = realloc(vscratch.quads, (size_t)cap * sizeof(VoxelQuad));
+        if (!p) return -1;
+        vscratch.quads = p;
+        vscratch.cap_quads = cap;
+    }
+    vscratch.quads[vscratch.num_quads++] = q;
+    return 0;
+}
+
+/* Merge one slice of same-material faces into maximal rectangles: widen
+ * along u, then grow along v while the whole run matches. Returns -1 if
+ * the quad list cannot grow. */
+static int voxel_greedy_slice(int dir, int slice) {
+    uint8_t (*m)[VOXEL_CHUNK] = vscratch.mask[slice];
+    for (int v = 0; v < VOXEL_CHUNK; v++) {
+        for (int u = 0; u < VOXEL_CHUNK; u++) {
+            uint8_t mat = m[v][u];
+            if (!mat) continue;
+            int w = 1, h = 1;
+            while (u + w < VOXEL_CHUNK && m[v][u + w] == mat) w++;
+            for (; v + h < VOXEL_CHUNK; h++) {
+                int k = 0;
+                while (k < w && m[v + h][u + k] == mat) k++;
+                if (k < w) break;
+            }
+            for (int j = 0; j < h; j++) memset(&m[v + j][u], 0, (size_t)w);
+            if (voxel_push_quad((VoxelQuad){(uint8_t)dir, mat, (uint8_t)slice, (uint8_t)u, (uint8_t)v,
+                                            (uint8_t)w, (uint8_t)h}) < 0)
+                return -1;
+            u += w - 1;
+        }
+    }
+    return 0;
+}
+
+/* Rebuild chunk (cx, cy, cz) as one quad per merged rectangle. Returns -1,
+ * leaving the chunk empty, if memory runs out. */
+static int voxel_mesh_chunk(VoxelGrid *g, int cx, int cy, int cz) {
+    Mesh *mesh = &g->chunks[(cz * g->nc + cy) * g->nc + cx];
+    int ox = cx * VOXEL_CHUNK, oy = cy * VOXEL_CHUNK, oz = cz * VOXEL_CHUNK;
+    vscratch.num_quads = 0;
+    for (int dir = 0; dir < 6; dir++) {
+        int axis = dir / 2;
+        memset(vscratch.mask, 0, sizeof(vscratch.mask));
+        int any = 0;
+        for (int lz = 0; lz < VOXEL_CHUNK; lz++) {
+            for (int ly = 0; ly < VOXEL_CHUNK; ly++) {
+                uint32_t vis = voxel_faces(g, dir, cx, oy + ly, oz + lz);
+                const uint8_t *mat = g->mat + ((oz + lz) * g->n + oy + ly) * g->n + ox;
+                while (vis) {
+                    int lx = __builtin_ctz(vis);
+                    vis &= vis - 1;
+                    uint8_t *cell = axis == 0 ? &vscratch.mask[lx][lz][ly]
+                                  : axis == 1 ? &vscratch.mask[ly][lz][lx]
+                                  : &vscratch.mask[lz][ly][lx];
+                    *cell = mat[lx];
+                    any = 1;
+                }
+            }
+        }
+        if (!any) continue;
+        for (int slice = 0; slice < VOXEL_CHUNK; slice++)
+            if (voxel_greedy_slice(dir, slice) < 0) {
+                mesh_free(mesh);
+                return -1;
+            }
+    }
+
+    mesh_free(mesh);
+    int nq = vscratch.num_quads;
+    if (!nq) return 0;
+    if (mesh_alloc(mesh, nq * 4, nq * 2) < 0) return -1;
+    static const int uaxis[3] = {1, 0, 0}, vaxis[3] = {2, 2, 1};
+    static const float normal[6][3] = {{1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}};
+    for (int q = 0; q < nq; q++) {
+        const VoxelQuad *vq = &vscratch.quads[q];
+        int axis = vq->dir / 2, neg = vq->dir & 1;
+        float plane = (float)(vq->slice + !neg);
+        float corner[4][2] = {{vq->u, vq->v}, {(float)(vq->u + vq->w), vq->v},
+                              {(float)(vq->u + vq->w), (float)(vq->v + vq->h)},
+                              {vq->u, (float)(vq->v + vq->h)}};
+        for (int k = 0; k < 4; k++) {
+            float p[3];
+            p[axis] = plane;
+            p[uaxis[axis]] = corner[k][0];
+            p[vaxis[axis]] = corner[k][1];
+            int vi = q * 4 + k;
+            mesh->px[vi] = p[0] + (float)ox;
+            mesh->py[vi] = p[1] + (float)oy;
+            mesh->pz[vi] = p[2] + (float)oz;
+            mesh->nx[vi] = normal[vq->dir][0];
+            mesh->ny[vi] = normal[vq->dir][1];
+            mesh->nz[vi] = normal[vq->dir][2];
+        }
+        /* u x v is +x, -y, +z for the three axes; wind so the face
+         * normal points out of the solid side. */
+        int flip = neg != (axis == 1);
+        int *t = mesh->idx + q * 6, b = q * 4;
+        t[0] = b; t[1] = b + (flip ? 2 : 1); t[2] = b + (flip ? 1 : 2);
+        t[3] = b; t[4] = b + (flip ? 3 : 2); t[5] = b + (flip ? 2 : 3);
+        mesh->colors[q * 2] = mesh->colors[q * 2 + 1] = VOXEL_PALETTE[vq->mat];
+    }
+    mesh->center = v3(ox + VOXEL_CHUNK * 0.5, oy + VOXEL_CHUNK * 0.5, oz + VOXEL_CHUNK * 0.5);
+    mesh->radius = VOXEL_CHUNK * 0.5 * sqrt(3.0);
+    return 0;
+}
+
+/* Re-mesh every dirty chunk; returns how many were rebuilt. A chunk that
+ * runs out of memory stays dirty, and empty, until a later frame. */
+static int voxels_remesh(VoxelGrid *g) {
+    int n = 0;
+    for (int cz = 0, i = 0; cz < g->nc; cz++)
+        for (int cy = 0; cy < g->nc; cy++)
+            for (int cx = 0; cx < g->nc; cx++, i++) {
+                if (!g->dirty[i] || voxel_mesh_chunk(g, cx, cy, cz) < 0) continue;
+                g->dirty[i] = 0;
+                n++;
+            }
+    return n;
+}
+
+/* Rolling terrain under a water line, coloured by height. */
+static void voxels_init_terrain(VoxelGrid *g) {
+    int n = g->n;
+    int water = (int)(n * 0.3);
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            double u = (double)x / n, w = (double)z / n;
+            double h = 0.32 + 0.12 * sin(u * 9.0) * cos(w * 7.0) + 0.08 * sin((u + w) * 17.0)
+                     + 0.05 * cos(u * 23.0 - w * 13.0);
+            int top = (int)(h * n);
+            uint8_t surface = top < water + 2 ? 2 : h < 0.42 ? 3 : h < 0.5 ? 4 : 5;
+            for (int y = 0; y <= top || y <= water; y++) {
+                uint8_t m = y > top ? 1 : y > top - 3 ? surface : 4;
+                voxel_set(g, x, y, z, m);
+            }
+        }
+    }
+}
+
+/* Move a ball of brush voxels around an orbit above the terrain, so every
+ * frame edits a few chunks and exercises the incremental re-mesh. */
+static void voxels_animate(VoxelGrid *g) {
+    int n = g->n, r = n / 14 > 1 ? n / 14 : 1;
+    int c[3] = {(int)(n * (0.5 + 0.3 * cos(time_global * 0.8))), (int)(n * 0.78),
+                (int)(n * (0.5 + 0.3 * sin(time_global * 0.8)))};
+    if (g->brush_on && !memcmp(c, g->brush, sizeof(c))) return;
+    for (int pass = g->brush_on ? 0 : 1; pass < 2; pass++) {
+        const int *b = pass ? c : g->brush;
+        for (int z = -r; z <= r; z++)
+            for (int y = -r; y <= r; y++)
+                for (int x = -r; x <= r; x++) {
+                    if (x * x + y * y + z * z > r * r) continue;
+                    int px = b[0] + x, py = b[1] + y, pz = b[2] + z;
+                    if (px < 0 || px >= n || py < 0 || py >= n || pz < 0 || pz >= n) continue;
+                    uint8_t cur = g->mat[(pz * n + py) * n + px];
+                    if (pass == 0 && cur == VOXEL_BRUSH) voxel_set(g, px, py, pz, 0);
+                    if (pass == 1 && cur == 0) voxel_set(g, px, py, pz, VOXEL_BRUSH);
+                }
+    }
+    memcpy(g->brush, c, sizeof(c));
+    g->brush_on = 1;
+}
+
+/* Grid space [0, n)^3 onto the cube's [-1, 1]^3. */
+static Mat4 voxel_fit(const VoxelGrid *g) {
+    double s = 2.0 / g->n;
+    Mat4 sc = mat4_identity();
+    sc.m[0][0] = sc.m[1][1] = sc.m[2][2] = s;
+    return mat4_mul(sc, mat4_translate(-g->n * 0.5, -g->n * 0.5, -g->n * 0.5));
+}
+
+/* Chunks are culled by bounding sphere, ordered by depth and drawn like any
+ * other mesh. */
+static void render_voxels(VoxelGrid *g) {
+    Mat4 mv = mat4_mul(mat4_translate(0, 0, -view_dist), mat4_euler(rot_x, rot_y, rot_z));
+    mv = mat4_mul(mv, voxel_fit(g));
+    Mat4f mvf = mat4f_from(&mv);
+    int count = g->nc * g->nc * g->nc;
+    soa_transform_points(&mvf, g->cx, g->cy, g->cz, g->vx, g->vy, g->vz, count);
+    soa_cull_spheres(g->vx, g->vy, g->vz, g->vr, g->visible, count);
+    int n = 0;
+    for (int i = 0; i < count; i++)
+        if (g->visible[i] && g->chunks[i].num_tris) g->list[n++] = i;
+    depth_sort(g->list, n, g->vz);
+    for (int j = 0; j < n; j++) render_mesh(&g->chunks[g->list[j]], &mv, rgb(255,255,255), 1.0);
+    frame_stats.instances += n;
+}
+
+/* ---- particles ----
+ * Sparks thrown off the corners of the scene's rotating bounding cube, kept
+ * in view space as SoA floats. The update runs eight particles per AVX step
+ * (drag, gravity, integrate, age); the few that expire respawn scalar at a
+ * random corner. The splat projects eight at a time as well, then adds each
+ * surviving point's colour, packed 21 bits a channel, into a 64-bit word
+ * per sample: depth-tested against the scene but never writing depth, so
+ * sparks need no ordering, and the many that land on one sample chain on
+ * a plain integer add rather than a 3-byte colour. One pass then adds the
+ * words into the frame. The update can be split across threads; the
+ * splat stays on one. */
+#define MAX_PARTICLES (1 << 22)
+#define PARTICLES_DEFAULT (1 << 17)
+#define PARTICLE_LIFE 1.6f      /* seconds, longest */
+#define PARTICLE_GRAVITY 3.0f   /* per unit of extent */
+#define PARTICLE_DRAG 0.6f      /* fraction of speed lost per second */
+#define SPARK_RAMP 64
+
+typedef struct {
+    int count;
+    float *x, *y, *z, *vx, *vy, *vz, *life;
+    float extent;               /* emitter cube half-size */
+    float corner[8][3];         /* this frame's emitter corners, view space */
+    float dir[8][3];            /* their outward unit directions */
+    double last;                /* time_global at the last update */
+    uint32_t frame;
+} Particles;
+
+static Particles scene_particles;
+static int particles_enabled = 0;
+static int particle_threads = 1;    /* update threads, 0: one per core */
+static uint64_t spark_ramp[SPARK_RAMP];   /* packed r | g << 21 | b << 42 */
+
+static struct {
+    int width, rows;
+    uint64_t *acc;      /* per sample, plus one slot for points off screen */
+    float *depth;
+} sparks;
+
+static void sparks_free(void) {
+    free(sparks.acc);
+    free(sparks.depth);
+    memset(&sparks, 0, sizeof(sparks));
+}
+
+static inline uint32_t xorshift32(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return *s = x;
+}
+
+static inline float rand01(uint32_t *s) {
+    return (float)(xorshift32(s) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Half-size of the cube the scene turns inside: the fitted model's, or the
+ * lattice's outermost instance. */
+static float scene_extent(void) {
+    const Instances *in = &scene_instances;
+    float e = 1.0f;
+    for (int i = 0; i < in->count; i++)
+        e = fmaxf(e, fmaxf(fabsf(in->x[i]), fmaxf(fabsf(in->y[i]), fabsf(in->z[i]))) + in->scale[i]);
+    return e;
+}
+
+static void particles_free(Particles *ps) {
+    free(ps->x);
+    memset(ps, 0, sizeof(*ps));
+    sparks_free();
+}
+
+/* Restarts particle i at a random corner, age seconds into its flight. */
+static void particle_spawn(Particles *ps, int i, uint32_t *seed, float age) {
+    int k = (int)(xorshift32(seed) & 7);
+    float speed = ps->extent * (0.8f + 1.6f * rand01(seed));
+    float vx = (ps->dir[k][0] + rand01(seed) - 0.5f) * speed;
+    float vy = (ps->dir[k][1] + rand01(seed) - 0.5f) * speed;
+    float vz = (ps->dir[k][2] + rand01(seed) - 0.5f) * speed;
+    ps->vx[i] = vx; ps->vy[i] = vy; ps->vz[i] = vz;
+    ps->x[i] = ps->corner[k][0] + vx * age;
+    ps->y[i] = ps->corner[k][1] + vy * age;
+    ps->z[i] = ps->corner[k][2] + vz * age;
+    ps->life[i] = PARTICLE_LIFE * (0.3f + 0.7f * rand01(seed)) - age;
+}
+
+static void particles_emitter(Particles *ps) {
+    Mat4 rot = mat4_euler(rot_x, rot_y, rot_z);
+    for (int k = 0; k < 8; k++) {
+        Vec3 d = normalize(mat4_point(&rot, v3(k & 1 ? 1 : -1, k & 2 ? 1 : -1, k & 4 ? 1 : -1)));
+        ps->dir[k][0] = (float)d.x;
+        ps->dir[k][1] = (float)d.y;
+        ps->dir[k][2] = (float)d.z;
+        ps->corner[k][0] = (float)(d.x * sqrt(3.0) * ps->extent);
+        ps->corner[k][1] = (float)(d.y * sqrt(3.0) * ps->extent);
+        ps->corner[k][2] = (float)(d.z * sqrt(3.0) * ps->extent - view_dist);
+    }
+}
+
+static int particles_init(Particles *ps, int count, float extent) {
+    memset(ps, 0, sizeof(*ps));
+    ps->x = alloc_aligned((size_t)count * 7 * sizeof(float));
+    if (!ps->x) return -1;
+    ps->y = ps->x + count;
+    ps->z = ps->y + count;
+    ps->vx = ps->z + count;
+    ps->vy = ps->vx + count;
+    ps->vz = ps->vy + count;
+    ps->life = ps->vz + count;
+    ps->count = count;
+    ps->extent = extent;
+    ps->last = time_global;
+    particles_emitter(ps);
+    uint32_t seed = 0x9e3779b9u;
+    for (int i = 0; i < count; i++) particle_spawn(ps, i, &seed, PARTICLE_LIFE * rand01(&seed) * 0.3f);
+    if (!spark_ramp[SPARK_RAMP - 1]) {
+        /* Dim red embers to near-white, at half intensity since sparks add up. */
+        for (int i = 0; i < SPARK_RAMP; i++) {
+            double t = (double)i / (SPARK_RAMP - 1);
+            spark_ramp[i] = (uint64_t)(40 + 100 * t) | (uint64_t)(120 * t * t) << 21 | (uint64_t)(90 * t * t * t) << 42;
+        }
+    }
+    return 0;
+}
+
+/* Particles [lo, hi) through one step of dt. */
+static void particles_step(Particles *ps, int lo, int hi, float dt, uint32_t seed) {
+    float drag = 1.0f - PARTICLE_DRAG * dt, g = -PARTICLE_GRAVITY * ps->extent * dt;
+    int i = lo;
+#if defined(__AVX__)
+    const __m256 vdt = _mm256_set1_ps(dt), vdrag = _mm256_set1_ps(drag), vg = _mm256_set1_ps(g);
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= hi; i += 8) {
+        __m256 vx = _mm256_mul_ps(_mm256_loadu_ps(ps->vx + i), vdrag);
+        __m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->vy + i), vdrag), vg);
+        __m256 vz = _mm256_mul_ps(_mm256_loadu_ps(ps->vz + i), vdrag);
+        _mm256_storeu_ps(ps->vx + i, vx);
+        _mm256_storeu_ps(ps->vy + i, vy);
+        _mm256_storeu_ps(ps->vz + i, vz);
+        _mm256_storeu_ps(ps->x + i, _mm256_add_ps(_mm256_loadu_ps(ps->x + i), _mm256_mul_ps(vx, vdt)));
+        _mm256_storeu_ps(ps->y + i, _mm256_add_ps(_mm256_loadu_ps(ps->y + i), _mm256_mul_ps(vy, vdt)));
+        _mm256_storeu_ps(ps->z + i, _mm256_add_ps(_mm256_loadu_ps(ps->z + i), _mm256_mul_ps(vz, vdt)));
+        __m256 life = _mm256_sub_ps(_mm256_loadu_ps(ps->life + i), vdt);
+        _mm256_storeu_ps(ps->life + i, life);
+        int dead = _mm256_movemask_ps(_mm256_cmp_ps(life, zero, _CMP_LE_OQ));
+        while (dead) {
+            particle_spawn(ps, i + __builtin_ctz((unsigned)dead), &seed, 0.0f);
+            dead &= dead - 1;
+        }
+    }
+#endif
+    for (; i < hi; i++) {
+        ps->vx[i] *= drag;
+        ps->vy[i] = ps->vy[i] * drag + g;
+        ps->vz[i] *= drag;
+        ps->x[i] += ps->vx[i] * dt;
+        ps->y[i] += ps->vy[i] * dt;
+        ps->z[i] += ps->vz[i] * dt;
+        ps->life[i] -= dt;
+        if (ps->life[i] <= 0) particle_spawn(ps, i, &seed, 0.0f);
+    }
+}
+
+typedef struct {
+    Particles *ps;
+    int lo, hi;
+    float dt;
+    uint32_t seed;
+} ParticleWork;
+
+static void *particles_step_thread(void *arg) {
+    ParticleWork *w = arg;
+    particles_step(w->ps, w->lo, w->hi, w->dt, w->seed);
+    return NULL;
+}
+
+/* Ranges split on multiples of eight so every worker stays on whole AVX
+ * steps; each gets its own respawn seed. */
+static void particles_update(Particles *ps, float dt, int threads) {
+    ps->frame++;
+    particles_emitter(ps);
+    int n = threads > 0 ? threads : num_workers();
+    if (n > 16) n = 16;
+    if (n > ps->count / 4096) n = ps->count / 4096 > 0 ? ps->count / 4096 : 1;
+    ParticleWork work[16];
+    int per = (ps->count / n + 7) & ~7;
+    for (int t = 0; t < n; t++) {
+        int lo = t * per, hi = t == n - 1 ? ps->count : (t + 1) * per;
+        work[t] = (ParticleWork){ps, lo < ps->count ? lo : ps->count, hi < ps->count ? hi : ps->count, dt,
+                                 (ps->frame * 16u + (uint32_t)t) * 0x9e3779b9u | 1u};
+    }
+    if (n == 1) particles_step_thread(&work[0]);
+    else run_parallel(particles_step_thread, work, sizeof(work[0]), n);
+}
+
+/* The frame's depth in sample order as float, bias folded in, with a slot
+ * past the end that fails every test for points off the screen. */
+static int sparks_begin(void) {
+    int w = buf.width, rows = buf.height * 2;
+    size_t n = (size_t)w * (size_t)rows;
+    if (!sparks.acc || sparks.width != w || sparks.rows != rows) {
+        sparks_free();
+        sparks.acc = alloc_aligned((n + 1) * sizeof(uint64_t));
+        sparks.depth = alloc_aligned((n + 1) * sizeof(float));
+        if (!sparks.acc || !sparks.depth) {
+            sparks_free();
+            return -1;
+        }
+        sparks.width = w;
+        sparks.rows = rows;
+        memset(sparks.acc, 0, (n + 1) * sizeof(uint64_t));
+    }
+    for (int y = 0; y < rows; y++) {
+        Color *col; double *depth; double bias;
+        sample_row(y, &col, &depth, &bias);
+        float *d = sparks.depth + (size_t)y * (size_t)w;
+        for (int x = 0; x < w; x++) d[x] = (float)(depth[x] - bias);
+    }
+    sparks.depth[n] = INFINITY;
+    return 0;
+}
+
+/* Saturating add of the accumulated sparks into the frame; the plane is
+ * cleared as it is read. */
+static void sparks_resolve(void) {
+    const uint64_t m = (1u << 21) - 1;
+    for (int y = 0; y < sparks.rows; y++) {
+        Color *col; double *depth; double bias;
+        sample_row(y, &col, &depth, &bias);
+        uint64_t *acc = sparks.acc + (size_t)y * (size_t)sparks.width;
+        for (int x = 0; x < sparks.width; x++) {
+            uint64_t a = acc[x];
+            if (!a) continue;
+            acc[x] = 0;
+            Color c = col[x];
+            uint64_t r = c.r + (a & m), g = c.g + (a >> 21 & m), b = c.b + (a >> 42 & m);
+            col[x] = rgb((uint8_t)(r > 255 ? 255 : r), (uint8_t)(g > 255 ? 255 : g), (uint8_t)(b > 255 ? 255 : b));
+            if (depth[x] <= -1e9) depth[x] = DEPTH_FRINGE;
+            frame_stats.particles++;
+        }
+    }
+    sparks.acc[(size_t)sparks.width * (size_t)sparks.rows] = 0;
+}
+
+/* Sparks land where they fall, so a per-point branch would mispredict on
+ * every other particle. The AVX2 path stays branch-free instead: lanes off
+ * the screen index the failing slot, depth comes in by gather, and a lane
+ * that fails the test adds zero. */
+static void particles_splat(const Particles *ps) {
+    if (sparks_begin() < 0) return;
+    float s = (float)proj_scale();
+    float cx = (float)(buf.width * 0.5), cy = (float)buf.height;
+    float w_max = (float)buf.width, h_max = (float)(buf.height * 2);
+    float ramp_k = (SPARK_RAMP - 1) / PARTICLE_LIFE;
+    int w = sparks.width, off = w * sparks.rows;
+    uint64_t *acc = sparks.acc;
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256 vs = _mm256_set1_ps(s), vnegs = _mm256_set1_ps(-s);
+    const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy);
+    const __m256 near_w = _mm256_set1_ps((float)NEAR_W), zero = _mm256_setzero_ps();
+    const __m256 vw = _mm256_set1_ps(w_max), vh = _mm256_set1_ps(h_max);
+    const __m256 vk = _mm256_set1_ps(ramp_k), vtop = _mm256_set1_ps(SPARK_RAMP - 1);
+    const __m256i vwi = _mm256_set1_epi32(w), voff = _mm256_set1_epi32(off);
+    for (; i + 8 <= ps->count; i += 8) {
+        __m256 z = _mm256_loadu_ps(ps->z + i);
+        __m256 wz = _mm256_sub_ps(zero, z);
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(wz, near_w));
+        __m256 sx = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->x + i), vs), inv), vcx);
+        __m256 sy = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->y + i), vnegs), inv), vcy);
+        __m256 ok = _mm256_and_ps(_mm256_cmp_ps(wz, near_w, _CMP_GT_OQ),
+                    _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(sx, zero, _CMP_GE_OQ), _mm256_cmp_ps(sx, vw, _CMP_LT_OQ)),
+                                  _mm256_and_ps(_mm256_cmp_ps(sy, zero, _CMP_GE_OQ), _mm256_cmp_ps(sy, vh, _CMP_LT_OQ))));
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(sy), vwi), _mm256_cvttps_epi32(sx));
+        idx = _mm256_blendv_epi8(voff, idx, _mm256_castps_si256(ok));
+        __m256 pass = _mm256_cmp_ps(z, _mm256_i32gather_ps(sparks.depth, idx, 4), _CMP_GT_OQ);
+        __m256 life = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(ps->life + i), vk), zero), vtop);
+        int32_t li[8], ri[8], pi[8];
+        _mm256_storeu_si256((__m256i *)li, idx);
+        _mm256_storeu_si256((__m256i *)ri, _mm256_cvttps_epi32(life));
+        _mm256_storeu_si256((__m256i *)pi, _mm256_castps_si256(pass));
+        for (int k = 0; k < 8; k++) acc[li[k]] += spark_ramp[ri[k]] & (uint64_t)(int64_t)pi[k];
+    }
+#endif
+    for (; i < ps->count; i++) {
+        float wz = -ps->z[i];
+        if (!(wz > (float)NEAR_W)) continue;
+        float sx = ps->x[i] * s / wz + cx, sy = -ps->y[i] * s / wz + cy;
+        if (!(sx >= 0 && sx < w_max && sy >= 0 && sy < h_max)) continue;
+        int j = (int)sy * w + (int)sx;
+        if (!(ps->z[i] > sparks.depth[j])) continue;
+        int r = (int)(ps->life[i] * ramp_k);
+        acc[j] += spark_ramp[r < 0 ? 0 : (r >= SPARK_RAMP ? SPARK_RAMP - 1 : r)];
+    }
+    sparks_resolve();
+}
+
+/* Steps by the time since the last frame (at most 0.1 s) and splats. */
+static void particles_frame(Particles *ps) {
+    double dt = time_global - ps->last;
+    ps->last = time_global;
+    particles_update(ps, (float)(dt < 0 ? 0 : (dt > 0.1 ? 0.1 : dt)), particle_threads);
+    particles_splat(ps);
+}
+
+/* ---- SDF raymarching ----
+ * An alternative to rasterizing the scene: every half-block sample
+ * sphere-traces a signed distance field (a rounded cube intersected with a
+ * sphere, less three axis cylinders) turning with the mesh's rotation.
+ * Samples go in tiles of 8 x 8. Each tile first cone-marches its whole
+ * bundle of rays from the bounding sphere, which either proves the tile
+ * empty or gives every ray in it a common safe start; rays then stop at a
+ * hit within their own footprint, past the bound, or after SDF_MAX_STEPS.
+ * Rows of tiles are dealt round-robin to threads, each writing only its
+ * own samples of the shared Buffer, so buf_render() is unchanged. */
+enum { RENDER_RASTER, RENDER_SDF };
+static int render_mode = RENDER_RASTER;
+static int sdf_threads = 0;     /* 0: one per core */
+
+#define SDF_TILE 8
+#define SDF_MAX_STEPS 96
+#define SDF_CONE_STEPS 32
+#define SDF_BOUND 1.25f         /* bounding sphere radius, object space */
+
+static struct {
+    float r[3][3];              /* view to object rotation */
+    float o[3];                 /* eye in object space */
+    float s, cx, cy;            /* projection, as soa_project() */
+    float pix;                  /* half a sample's footprint at unit distance */
+    int rows, tile_rows, tile_cols;
+} sdf;
+
+typedef struct {
+    int first, step;
+    long rays, steps;
+} SdfWork;
+
+static inline float sdf_scene(float x, float y, float z) {
+    float qx = fabsf(x) - 0.8f, qy = fabsf(y) - 0.8f, qz = fabsf(z) - 0.8f;
+    float ox = fmaxf(qx, 0.0f), oy = fmaxf(qy, 0.0f), oz = fmaxf(qz, 0.0f);
+    float box = sqrtf(ox * ox + oy * oy + oz * oz) + fminf(fmaxf(qx, fmaxf(qy, qz)), 0.0f) - 0.2f;
+    float ball = sqrtf(x * x + y * y + z * z) - SDF_BOUND;
+    float cyl = sqrtf(fminf(x * x + y * y, fminf(y * y + z * z, z * z + x * x))) - 0.45f;
+    return fmaxf(fmaxf(box, ball), -cyl);
+}
+
+/* Gradient from four evaluations on a tetrahedron. */
+static void sdf_normal(const float *p, float *n) {
+    const float h = 1e-3f;
+    float a = sdf_scene(p[0] + h, p[1] - h, p[2] - h), b = sdf_scene(p[0] - h, p[1] - h, p[2] + h);
+    float c = sdf_scene(p[0] - h, p[1] + h, p[2] - h), d = sdf_scene(p[0] + h, p[1] + h, p[2] + h);
+    float x = a - b - c + d, y = -a - b + c + d, z = -a + b - c + d;
+    float inv = 1.0f / sqrtf(fmaxf(x * x + y * y + z * z, 1e-20f));
+    n[0] = x * inv; n[1] = y * inv; n[2] = z * inv;
+}
+
+/* Unit view-space direction through sample point (px, py). */
+static inline void sdf_dir(float px, float py, float *d) {
+    float x = (px - sdf.cx) / sdf.s, y = -(py - sdf.cy) / sdf.s;
+    float inv = 1.0f / sqrtf(x * x + y * y + 1.0f);
+    d[0] = x * inv; d[1] = y * inv; d[2] = -inv;
+}
+
+static inline void sdf_to_object(const float *v, float *o) {
+    for (int i = 0; i < 3; i++) o[i] = sdf.r[i][0] * v[0] + sdf.r[i][1] * v[1] + sdf.r[i][2] * v[2];
+}
+
+/* One ray from t, object-space direction d: the hit distance, or -1. */
+static inline float sdf_trace(const float *d, float t, float t_far, long *steps) {
+    for (int i = 0; i < SDF_MAX_STEPS; i++) {
+        float dist = sdf_scene(sdf.o[0] + d[0] * t, sdf.o[1] + d[1] * t, sdf.o[2] + d[2] * t);
+        if (dist < t * sdf.pix) { *steps += i + 1; return t; }
+        t += dist;
+        if (t > t_far) { *steps += i + 1; return -1.0f; }
+    }
+    *steps += SDF_MAX_STEPS;
+    return -1.0f;
+}
+
+/* The tile's rays lie within angle a of its centre ray, so at distance t
+ * they are all within t * 2 sin(a/2) of it: while the field at the centre
+ * ray exceeds that radius the whole bundle is clear, and it advances by
+ * the excess shrunk so the next radius is covered too. Returns the common
+ * start, or -1 if the bundle leaves the bound without touching anything. */
+static float sdf_cone(int x0, int y0, int x1, int y1, float t, float t_far) {
+    float dc[3], dco[3], cos_min = 1.0f;
+    sdf_dir((float)(x0 + x1) * 0.5f, (float)(y0 + y1) * 0.5f, dc);
+    for (int k = 0; k < 4; k++) {
+        float d[3];
+        sdf_dir(k & 1 ? (float)x1 : (float)x0, k & 2 ? (float)y1 : (float)y0, d);
+        cos_min = fminf(cos_min, d[0] * dc[0] + d[1] * dc[1] + d[2] * dc[2]);
+    }
+    float k = sqrtf(fmaxf(2.0f - 2.0f * cos_min, 0.0f));
+    sdf_to_object(dc, dco);
+    for (int i = 0; i < SDF_CONE_STEPS && t <= t_far; i++) {
+        float r = t * k;
+        float dist = sdf_scene(sdf.o[0] + dco[0] * t, sdf.o[1] + dco[1] * t, sdf.o[2] + dco[2] * t);
+        if (dist <= r + t * sdf.pix) return t;
+        t += (dist - r) / (1.0f + k);
+    }
+    return t <= t_far ? t : -1.0f;
+}
+
+static void sdf_shade(int x, int y, const float *dv, const float *d, float t) {
+    float p[3] = {sdf.o[0] + d[0] * t, sdf.o[1] + d[1] * t, sdf.o[2] + d[2] * t}, n[3], nv[3];
+    sdf_normal(p, n);
+    for (int i = 0; i < 3; i++) nv[i] = sdf.r[0][i] * n[0] + sdf.r[1][i] * n[1] + sdf.r[2][i] * n[2];
+    float ax = fabsf(n[0]), ay = fabsf(n[1]), az = fabsf(n[2]);
+    int face = az >= ax && az >= ay ? (n[2] < 0 ? 0 : 1) : ax >= ay ? (n[0] < 0 ? 2 : 3) : (n[1] > 0 ? 4 : 5);
+    float b = light_face(nv[0], nv[1], nv[2], dv[0] * t, dv[1] * t, dv[2] * t, NULL);
+    Color *col; double *depth; double bias;
+    sample_row(y, &col, &depth, &bias);
+    col[x] = shade(FACE_COLORS[face], b);
+    depth[x] = dv[2] * t;
+}
+
+static void *sdf_tile_rows(void *arg) {
+    SdfWork *w = arg;
+    float dist = sqrtf(sdf.o[0] * sdf.o[0] + sdf.o[1] * sdf.o[1] + sdf.o[2] * sdf.o[2]);
+    float t_near = fmaxf(dist - SDF_BOUND, 0.0f), t_far = dist + SDF_BOUND;
+    for (int ty = w->first; ty < sdf.tile_rows; ty += w->step) {
+        int y0 = ty * SDF_TILE, y1 = y0 + SDF_TILE < sdf.rows ? y0 + SDF_TILE : sdf.rows;
+        for (int tx = 0; tx < sdf.tile_cols; tx++) {
+            int x0 = tx * SDF_TILE, x1 = x0 + SDF_TILE < buf.width ? x0 + SDF_TILE : buf.width;
+            float t0 = sdf_cone(x0, y0, x1, y1, t_near, t_far);
+            if (t0 < 0) continue;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    float dv[3], d[3];
+                    sdf_dir((float)x + 0.5f, (float)y + 0.5f, dv);
+                    sdf_to_object(dv, d);
+                    w->rays++;
+                    float t = sdf_trace(d, t0, t_far, &w->steps);
+                    if (t >= 0) sdf_shade(x, y, dv, d, t);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static void sdf_render(int threads) {
+    Mat4 rot = mat4_euler(rot_x, rot_y, rot_z);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++) sdf.r[i][j] = (float)rot.m[j][i];
+    float eye[3] = {0.0f, 0.0f, (float)view_dist};
+    sdf_to_object(eye, sdf.o);
+    sdf.s = (float)proj_scale();
+    sdf.cx = (float)(buf.width * 0.5);
+    sdf.cy = (float)buf.height;
+    sdf.pix = 0.5f / sdf.s;
+    sdf.rows = buf.height * 2;
+    sdf.tile_rows = (sdf.rows + SDF_TILE - 1) / SDF_TILE;
+    sdf.tile_cols = (buf.width + SDF_TILE - 1) / SDF_TILE;
+
+    int n = threads > 0 ? threads : num_workers();
+    if (n > 16) n = 16;
+    if (n > sdf.tile_rows) n = sdf.tile_rows;
+    SdfWork work[16];
+    for (int i = 0; i < n; i++) work[i] = (SdfWork){i, n, 0, 0};
+    if (n == 1) sdf_tile_rows(&work[0]);
+    else run_parallel(sdf_tile_rows, work, sizeof(work[0]), n);
+    for (int i = 0; i < n; i++) {
+        frame_stats.sdf_rays += work[i].rays;
+        frame_stats.sdf_steps += work[i].steps;
+    }
+    frame_stats.instances = 1;
+}
+
+/* ---- shadow pass ---- */
+
+/* Aim the shadow map down the key light at a view-space sphere (c, r) and
+ * clear it. Map x, y follow light-space axes u, v at size / 2r texels per
+ * unit; depth is distance along the light direction. Returns -1 if the
+ * map cannot be allocated. */
+static int shadow_begin(Vec3 c, double r) {
+    int size = shadow.size;
+    if (!shadow.depth) shadow.depth = alloc_aligned((size_t)size * (size_t)size * sizeof(float));
+    if (!shadow.depth) return -1;
+    Vec3 l = v3(lights.dir[0][0], lights.dir[0][1], lights.dir[0][2]);
+    Vec3 up = fabs(l.y) < 0.9 ? v3(0, 1, 0) : v3(1, 0, 0);
+    Vec3 u = normalize(cross(up, l)), v = cross(l, u);
+    double k = size / (2.0 * r), h = size * 0.5;
+    Vec3 rows[3] = {scale(u, k), scale(v, -k), l};
+    double offs[3] = {h, h, 0};
+    Mat4 m = mat4_identity();
+    for (int i = 0; i < 3; i++) {
+        m.m[i][0] = rows[i].x; m.m[i][1] = rows[i].y; m.m[i][2] = rows[i].z;
+        m.m[i][3] = offs[i] - dot(rows[i], c);
+    }
+    shadow.from_view = m;
+    shadow.bias = 1.5 / k;
+    float *d = shadow.depth;
+    size_t n = (size_t)size * (size_t)size, i = 0;
+#if defined(__AVX__)
+    const __m256 empty = _mm256_set1_ps(-1e30f);
+    for (; i + 8 <= n; i += 8) _mm256_store_ps(d + i, empty);
+#endif
+    for (; i < n; i++) d[i] = -1e30f;
+    return 0;
+}
+
+static inline double map_area(const float *x, const float *y, const int *f) {
+    return ((double)x[f[1]] - x[f[0]]) * ((double)y[f[2]] - y[f[0]]) -
+           ((double)y[f[1]] - y[f[0]]) * ((double)x[f[2]] - x[f[0]]);
+}
+
+/* Depth of m's light-averted faces. Meshes wind outward, as the colour
+ * pass's back-face test already assumes, and map y points down, so a face
+ * turned away from the light has positive area in map space. */
+static void shadow_mesh(const Mesh *m, const Mat4 *model_view) {
+    Mat4 ls = mat4_mul(shadow.from_view, *model_view);
+    Mat4f lsf = mat4f_from(&ls);
+    if (scratch_reserve(m->num_verts, m->num_tris) < 0) return;
+    soa_transform_points(&lsf, m->px, m->py, m->pz, scratch.vx, scratch.vy, scratch.vz, m->num_verts);
+    const float *x = scratch.vx, *y = scratch.vy, *z = scratch.vz;
+    for (int t = 0; t < m->num_tris; t++) {
+        const int *f = m->idx + t * 3;
+        double area = map_area(x, y, f);
+        if (area > 1e-8)
+            raster_depth(v3(x[f[0]], y[f[0]], z[f[0]]), v3(x[f[1]], y[f[1]], z[f[1]]),
+                         v3(x[f[2]], y[f[2]], z[f[2]]), area, shadow.depth, shadow.size);
+    }
+}
+
+/* Every caster goes into the map, not just what the camera sees: an
+ * instance off screen still shades one that is on it. LOD levels are
+ * picked for the map's resolution at half the radius, a quarter of the
+ * triangle budget: a shadow only needs the caster's outline. Returns -1,
+ * drawing nothing, if the map cannot be allocated. */
+static int shadow_pass(void) {
+    Mat4 view = mat4_mul(mat4_translate(0, 0, -view_dist), mat4_euler(rot_x, rot_y, rot_z));
+    Instances *in = &scene_instances;
+    Vec3 c = v3(0, 0, -view_dist);
+    double r = sqrt(3.0);
+    if (!scene_voxels.n && in->count && scene_bvh.num_nodes) {
+        const BvhNode *root = &scene_bvh.nodes[0];
+        Vec3 lo = v3(root->lo[0], root->lo[1], root->lo[2]), hi = v3(root->hi[0], root->hi[1], root->hi[2]);
+        c = mat4_point(&view, scale(add(lo, hi), 0.5));
+        r = length(sub(hi, lo)) * 0.5;
+    }
+    if (shadow_begin(c, r) < 0) return -1;
+    double texels = shadow.size / (2.0 * r) * 0.5;
+    if (scene_voxels.n) {
+        VoxelGrid *g = &scene_voxels;
+        Mat4 mv = mat4_mul(view, voxel_fit(g));
+        for (int i = 0; i < g->nc * g->nc * g->nc; i++)
+            if (g->chunks[i].num_tris) shadow_mesh(&g->chunks[i], &mv);
+    } else if (in->count) {
+        Mat4 local = instances_local(scene_lod.level[0]);
+        for (int i = 0; i < in->count; i++) {
+            double s = in->scale[i];
+            Mat4 mv = instance_model_view(&local, s, mat4_point(&view, v3(in->x[i], in->y[i], in->z[i])));
+            shadow_mesh(lod_enabled ? lod_select_px(&scene_lod, sqrt(3.0) * s * texels) : scene_lod.level[0], &mv);
+        }
+    } else {
+        Mat4 mv = mat4_mul(view, mesh_fit(&scene_mesh));
+        shadow_mesh(lod_enabled ? lod_select_px(&scene_lod, sqrt(3.0) * texels) : scene_lod.level[0], &mv);
+    }
+    return 0;
+}
+
+static void shadow_free(void) {
+    free(shadow.depth);
+    shadow.depth = NULL;
+}
+
+/* Scene updates come first so the shadow pass sees this frame's geometry. */
+static void render_scene(void) {
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    lights_update();
+    if (scene_voxels.n) {
+        voxels_animate(&scene_voxels);
+        frame_stats.remeshed = voxels_remesh(&scene_voxels);
+    }
+    if (scene_instances.count && scene_instances.moving) instances_animate(&scene_instances, &scene_bvh);
+    int translucent = oit_enabled && render_mode == RENDER_RASTER;
+    if (translucent && oit_reserve() < 0) translucent = oit_enabled = 0;
+    if (render_mode == RENDER_SDF) {
+        sdf_render(sdf_threads);
+    } else {
+        if (shadow_enabled && shadow_pass() < 0) shadow_enabled = 0;
+        if (scene_voxels.n) {
+            render_voxels(&scene_voxels);
+        } else if (scene_instances.count) {
+            render_instances(&scene_lod, &scene_instances, &scene_bvh);
+        } else {
+            Mat4 model_view = mat4_mul(mat4_translate(0, 0, -view_dist), mat4_euler(rot_x, rot_y, rot_z));
+            model_view = mat4_mul(model_view, mesh_fit(&scene_mesh));
+            render_mesh(lod_select(&scene_lod, sqrt(3.0), view_dist), &model_view, rgb(255,255,255),
+                        oit_enabled ? translucent_alpha : 1.0);
+            frame_stats.instances = 1;
+        }
+    }
+    if (particles_enabled && scene_particles.count) particles_frame(&scene_particles);
+    if (translucent) oit_resolve();
+}
+
+static inline void buf_sample_row(const Buffer *b, int y, Color **col, double **depth) {
+    int row = (y / 2) * b->width;
+    *col = (y % 2 == 0 ? b->top_color : b->bot_color) + row;
+    *depth = (y % 2 == 0 ? b->top_depth : b->bot_depth) + row;
+}
+
+static void ssaa_set(int factor) {
+    if (ss_buf.top_color) {
+        Buffer screen = buf;
+        buf = ss_buf;
+        buf_free();
+        buf = screen;
+        memset(&ss_buf, 0, sizeof(ss_buf));
+        free(ss_acc);
+        free(ss_dmax);
+        ss_acc = NULL;
+        ss_dmax = NULL;
+    }
+    ssaa = factor;
+    if (factor <= 1) return;
+    Buffer screen = buf;
+    buf_init(screen.width * factor, screen.height * factor);
+    ss_buf = buf;
+    buf = screen;
+    ss_acc = malloc((size_t)ss_buf.width * sizeof(Color) * sizeof(uint16_t));
+    ss_dmax = malloc((size_t)ss_buf.width * sizeof(double));
+}
+
+/* Box-filter the factor x factor sample block behind every display sample.
+ * Sample rows are summed bytewise into 16-bit lanes (the Color planes are
+ * packed RGB), depth takes the nearest sample so coverage survives the
+ * resolve. Uncovered samples count as black. */
+static void ssaa_resolve(void) {
+    int f = ssaa;
+    int shift = f == 4 ? 4 : 2;
+    size_t nbytes = (size_t)ss_buf.width * sizeof(Color);
+    uint16_t *acc = ss_acc;
+    double *dmax = ss_dmax;
+
+    for (int y = 0; y < buf.height * 2; y++) {
+        for (int r = 0; r < f; r++) {
+            Color *c; double *d;
+            buf_sample_row(&ss_buf, y * f + r, &c, &d);
+            const uint8_t *src = (const uint8_t *)c;
+            size_t j = 0;
+            int x = 0;
+#if defined(__AVX2__)
+            for (; j + 16 <= nbytes; j += 16) {
+                __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + j)));
+                if (r) v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i *)(acc + j)));
+                _mm256_storeu_si256((__m256i *)(acc + j), v);
+            }
+            for (; x + 4 <= ss_buf.width; x += 4) {
+                __m256d v = _mm256_loadu_pd(d + x);
+                if (r) v = _mm256_max_pd(v, _mm256_loadu_pd(dmax + x));
+                _mm256_storeu_pd(dmax + x, v);
+            }
+#endif
+            for (; j < nbytes; j++) acc[j] = (uint16_t)(r ? acc[j] + src[j] : src[j]);
+            for (; x < ss_buf.width; x++) dmax[x] = r ? fmax(dmax[x], d[x]) : d[x];
+        }
+
+        Color *out; double *dout; double bias;
+        sample_row(y, &out, &dout, &bias);
+        for (int x = 0; x < buf.width; x++) {
+            const uint16_t *a = acc + (size_t)(x * f) * 3;
+            const double *dm = dmax + x * f;
+            unsigned r = 0, g = 0, b = 0;
+            double z = dm[0];
+            for (int k = 0; k < f; k++) {
+                r += a[3 * k]; g += a[3 * k + 1]; b += a[3 * k + 2];
+                if (dm[k] > z) z = dm[k];
+            }
+            out[x] = rgb((uint8_t)(r >> shift), (uint8_t)(g >> shift), (uint8_t)(b >> shift));
+            dout[x] = z;
+        }
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* ---- post-processing ----
+ * Full-frame passes between the raster and buf_render(), run on the display
+ * buffer after any SSAA resolve. Blurs gather both colour planes into one
+ * packed RGB image in sample-row order, so each filter is a byte stream:
+ * separable box filters summed in 16-bit lanes, sixteen bytes per AVX2
+ * step. A pass whose strength is zero is skipped. Light that spills onto
+ * empty samples marks them as fringe so buf_render() draws it. */
+enum { POST_GLOW, POST_BLOOM, POST_VIGNETTE, POST_PASSES };
+_Static_assert(POST_PASSES == sizeof(frame_stats.post_ms) / sizeof(double), "one timing per pass");
+static const char *const POST_NAMES[POST_PASSES] = {"glow", "bloom", "vignette"};
+#define BLOOM_THRESHOLD 200     /* bright-pass cut per channel */
+#define BLOOM_RADIUS 2
+#define GLOW_RADIUS 5
+#define POST_MAX_STRENGTH 8.0
+
+static int post_enabled = 0;
+static double post_strength[POST_PASSES] = {0.6, 0.8, 0.5};
+
+static struct {
+    int width, rows;
+    size_t stride;              /* bytes per sample row */
+    uint8_t *img, *tmp;         /* packed RGB, rows * stride */
+    uint16_t *vig_x, *vig_y;    /* 8.8 vignette factors per byte and per row */
+    double vig_strength;        /* the factors above were built for this */
+} post;
+
+static void post_free(void) {
+    free(post.img);
+    free(post.tmp);
+    free(post.vig_x);
+    free(post.vig_y);
+    memset(&post, 0, sizeof(post));
+}
+
+static int post_reserve(void) {
+    if (post.img && post.width == buf.width && post.rows == buf.height * 2) return 0;
+    post_free();
+    post.width = buf.width;
+    post.rows = buf.height * 2;
+    post.stride = (size_t)post.width * sizeof(Color);
+    post.img = alloc_aligned(post.stride * (size_t)post.rows);
+    post.tmp = alloc_aligned(post.stride * (size_t)post.rows);
+    post.vig_x = alloc_aligned(post.stride * sizeof(uint16_t));
+    post.vig_y = alloc_aligned((size_t)post.rows * sizeof(uint16_t));
+    post.vig_strength = -1;
+    if (!post.img || !post.tmp || !post.vig_x || !post.vig_y) {
+        post_free();
+        return -1;
+    }
+    return 0;
+}
+
+/* Copies the colour planes into post.img, minus cut per channel (saturating),
+ * so a cut of 0 is a plain copy and a high one keeps only the highlights. */
+static void post_gather(uint8_t cut) {
+    size_t n = post.stride;
+    for (int y = 0; y < post.rows; y++) {
+        Color *c; double *d;
+        buf_sample_row(&buf, y, &c, &d);
+        const uint8_t *src = (const uint8_t *)c;
+        uint8_t *dst = post.img + (size_t)y * n;
+        size_t j = 0;
+#if defined(__AVX2__)
+        __m256i vc = _mm256_set1_epi8((char)cut);
+        for (; j + 32 <= n; j += 32)
+            _mm256_storeu_si256((__m256i *)(dst + j),
+                _mm256_subs_epu8(_mm256_loadu_si256((const __m256i *)(src + j)), vc));
+#endif
+        for (; j < n; j++) dst[j] = (uint8_t)(src[j] > cut ? src[j] - cut : 0);
+    }
+}
+
+/* Box sums divide by a rounded-up reciprocal: sum * recip >> 16 gives back
+ * v for a flat run of v and never exceeds 255. */
+static inline uint16_t box_recip(int r) {
+    int taps = 2 * r + 1;
+    return (uint16_t)((65536 + taps - 1) / taps);
+}
+
+static inline uint8_t box_h_at(const uint8_t *s, size_t j, int r, uint32_t recip) {
+    int x = (int)(j / 3), c = (int)(j % 3);
+    uint32_t sum = 0;
+    for (int k = -r; k <= r; k++) {
+        int xx = x + k < 0 ? 0 : (x + k >= post.width ? post.width - 1 : x + k);
+        sum += s[xx * 3 + c];
+    }
+    return (uint8_t)((sum * recip) >> 16);
+}
+
+/* Horizontal box of radius r (1..8, so a sum fits 16 bits): neighbours are
+ * three bytes apart, so each tap is one unaligned load at j + 3k. Edges
+ * clamp and run scalar. */
+static void blur_h(const uint8_t *src, uint8_t *dst, int r) {
+    size_t n = post.stride, edge = (size_t)r * 3;
+    uint16_t recip = box_recip(r);
+    for (int y = 0; y < post.rows; y++) {
+        const uint8_t *s = src + (size_t)y * n;
+        uint8_t *d = dst + (size_t)y * n;
+        size_t j = 0;
+        for (; j < n && j < edge; j++) d[j] = box_h_at(s, j, r, recip);
+#if defined(__AVX2__)
+        __m256i vr = _mm256_set1_epi16((short)recip);
+        for (; j + 16 + edge <= n; j += 16) {
+            __m256i acc = _mm256_setzero_si256();
+            for (int k = -r; k <= r; k++)
+                acc = _mm256_add_epi16(acc, _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128((const __m128i *)(s + j + (ptrdiff_t)(3 * k)))));
+            acc = _mm256_mulhi_epu16(acc, vr);
+            _mm_storeu_si128((__m128i *)(d + j),
+                _mm_packus_epi16(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+        }
+#endif
+        for (; j < n; j++) d[j] = box_h_at(s, j, r, recip);
+    }
+}
+
+/* Vertical box: whole rows line up byte for byte, clamped at top and bottom. */
+static void blur_v(const uint8_t *src, uint8_t *dst, int r) {
+    size_t n = post.stride;
+    uint16_t recip = box_recip(r);
+    const uint8_t *rows[17];
+    for (int y = 0; y < post.rows; y++) {
+        for (int k = -r; k <= r; k++) {
+            int yy = y + k < 0 ? 0 : (y + k >= post.rows ? post.rows - 1 : y + k);
+            rows[k + r] = src + (size_t)yy * n;
+        }
+        uint8_t *d = dst + (size_t)y * n;
+        size_t j = 0;
+#if defined(__AVX2__)
+        __m256i vr = _mm256_set1_epi16((short)recip);
+        for (; j + 16 <= n; j += 16) {
+            __m256i acc = _mm256_setzero_si256();
+            for (int k = 0; k <= 2 * r; k++)
+                acc = _mm256_add_epi16(acc, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k] + j))));
+            acc = _mm256_mulhi_epu16(acc, vr);
+            _mm_storeu_si128((__m128i *)(d + j),
+                _mm_packus_epi16(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+        }
+#endif
+        for (; j < n; j++) {
+            uint32_t sum = 0;
+            for (int k = 0; k <= 2 * r; k++) sum += rows[k][j];
+            d[j] = (uint8_t)((sum * recip) >> 16);
+        }
+    }
+}
+
+static void post_blur(int r) {
+    blur_h(post.img, post.tmp, r);
+    blur_v(post.tmp, post.img, r);
+}
+
+/* Adds post.img scaled by strength onto the frame (saturating). With
+ * empty_only the light lands on uncovered samples alone, so a halo sits
+ * around the silhouette without washing over the model. */
+static void post_composite(double strength, int empty_only) {
+    size_t n = post.stride;
+    uint32_t s = (uint32_t)lround(strength * 256.0);
+    for (int y = 0; y < post.rows; y++) {
+        Color *c; double *d;
+        buf_sample_row(&buf, y, &c, &d);
+        const uint8_t *src = post.img + (size_t)y * n;
+        uint8_t *dst = (uint8_t *)c;
+        if (empty_only) {
+            for (int x = 0; x < post.width; x++) {
+                if (d[x] > -1e9) continue;
+                const uint8_t *p = src + x * 3;
+                uint32_t r = (p[0] * s) >> 8, g = (p[1] * s) >> 8, b = (p[2] * s) >> 8;
+                if (!(r | g | b)) continue;
+                c[x] = rgb((uint8_t)(r > 255 ? 255 : r), (uint8_t)(g > 255 ? 255 : g), (uint8_t)(b > 255 ? 255 : b));
+                d[x] = DEPTH_FRINGE;
+            }
+            continue;
+        }
+        size_t j = 0;
+#if defined(__AVX2__)
+        __m256i vs = _mm256_set1_epi16((short)(uint16_t)s);
+        for (; j + 16 <= n; j += 16) {
+            __m256i v = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + j))), 8);
+            v = _mm256_mulhi_epu16(v, vs);
+            __m128i add = _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            _mm_storeu_si128((__m128i *)(dst + j), _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(dst + j)), add));
+        }
+#endif
+        for (; j < n; j++) {
+            uint32_t v = dst[j] + ((src[j] * s) >> 8);
+            dst[j] = (uint8_t)(v > 255 ? 255 : v);
+        }
+        for (int x = 0; x < post.width; x++)
+            if (d[x] <= -1e9 && (c[x].r | c[x].g | c[x].b)) d[x] = DEPTH_FRINGE;
+    }
+}
+
+/* Darkens towards the corners by a separable (1 - a*u^2)(1 - a*v^2), u and v
+ * in [-1, 1] across the frame, so each sample is two 8.8 multiplies. */
+static void post_vignette(double strength) {
+    size_t n = post.stride;
+    if (post.vig_strength != strength) {
+        double a = strength * 0.5;
+        for (int x = 0; x < post.width; x++) {
+            double u = (x + 0.5) / post.width * 2.0 - 1.0, f = 1.0 - a * u * u;
+            uint16_t w = (uint16_t)lround(256.0 * (f < 0 ? 0 : f));
+            post.vig_x[x * 3] = post.vig_x[x * 3 + 1] = post.vig_x[x * 3 + 2] = w;
+        }
+        for (int y = 0; y < post.rows; y++) {
+            double v = (y + 0.5) / post.rows * 2.0 - 1.0, f = 1.0 - a * v * v;
+            post.vig_y[y] = (uint16_t)lround(256.0 * (f < 0 ? 0 : f));
+        }
+        post.vig_strength = strength;
+    }
+    for (int y = 0; y < post.rows; y++) {
+        Color *c; double *d;
+        buf_sample_row(&buf, y, &c, &d);
+        uint8_t *p = (uint8_t *)c;
+        uint32_t wy = post.vig_y[y];
+        size_t j = 0;
+#if defined(__AVX2__)
+        __m256i vy = _mm256_set1_epi16((short)wy);
+        for (; j + 16 <= n; j += 16) {
+            __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + j)));
+            v = _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_loadu_si256((const __m256i *)(post.vig_x + j))), 8);
+            v = _mm256_srli_epi16(_mm256_mullo_epi16(v, vy), 8);
+            _mm_storeu_si128((__m128i *)(p + j),
+                _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+        }
+#endif
+        for (; j < n; j++) p[j] = (uint8_t)((((p[j] * (uint32_t)post.vig_x[j]) >> 8) * wy) >> 8);
+    }
+}
+
+/* Glow first so bloom's spill doesn't count as covered; each pass's time
+ * lands in frame_stats.post_ms. */
+static void post_process(void) {
+    if (!post_enabled || post_reserve() < 0) return;
+    double t0 = now_sec(), t1;
+    if (post_strength[POST_GLOW] > 0) {
+        post_gather(0);
+        post_blur(GLOW_RADIUS);
+        post_composite(post_strength[POST_GLOW], 1);
+    }
+    t1 = now_sec();
+    frame_stats.post_ms[POST_GLOW] = (t1 - t0) * 1000.0;
+    if (post_strength[POST_BLOOM] > 0) {
+        post_gather(BLOOM_THRESHOLD);
+        post_blur(BLOOM_RADIUS);
+        post_composite(post_strength[POST_BLOOM] * 255.0 / (255 - BLOOM_THRESHOLD), 0);
+    }
+    t0 = now_sec();
+    frame_stats.post_ms[POST_BLOOM] = (t0 - t1) * 1000.0;
+    if (post_strength[POST_VIGNETTE] > 0) post_vignette(post_strength[POST_VIGNETTE]);
+    frame_stats.post_ms[POST_VIGNETTE] = (now_sec() - t0) * 1000.0;
+}
+
+static void render_frame(void) {
+    if (ssaa > 1) {
+        Buffer screen = buf;
+        buf = ss_buf;
+        buf_clear();
+        render_scene();
+        buf = screen;
+        ssaa_resolve();
+    } else {
+        buf_clear();
+        render_scene();
+    }
+    post_process();
+}
+
+static int handle_input(void) {
+    char c;
+    if (read(0, &c, 1) == 1) {
+        if (c == 'q' || c == 'Q' || c == 27) return 0;
+        if (c == '+' || c == '=') {
+            double nz = zoom * 1.1;
+            if (nz > 5.0) nz = 5.0;
+            zoom = nz;
+        } else if (c == '-' || c == '_') {
+            double nz = zoom / 1.1;
+            if (nz < 0.1) nz = 0.1;
+            zoom = nz;
+        } else if (c == 'r' || c == 'R') {
+            raster_mode = raster_mode == RASTER_SPAN ? RASTER_BBOX : RASTER_SPAN;
+        } else if (c == 'a' || c == 'A') {
+            aa_mode = aa_mode == AA_EDGE ? AA_NONE : AA_EDGE;
+        } else if (c == 'o' || c == 'O') {
+            draw_outline = !draw_outline;
+        } else if (c == 'g' || c == 'G') {
+            shade_mode = shade_mode == SHADE_GOURAUD ? SHADE_FLAT : SHADE_GOURAUD;
+        } else if (c == 'e' || c == 'E') {
+            light_space_set(light_space == LIGHT_LINEAR ? LIGHT_SRGB : LIGHT_LINEAR);
+        } else if (c == 'h' || c == 'H') {
+            shadow_enabled = !shadow_enabled;
+        } else if (c == 't' || c == 'T') {
+            texture_enabled = !texture_enabled;
+        } else if (c == 'l' || c == 'L') {
+            lod_enabled = !lod_enabled;
+            if (lod_enabled) lod_ensure(&scene_lod);
+        } else if (c == 'c' || c == 'C') {
+            cull_mode = cull_mode == CULL_BVH ? CULL_LINEAR : CULL_BVH;
+        } else if (c == 'i' || c == 'I') {
+            output_mode = output_mode == OUTPUT_ASCII ? OUTPUT_COLOR : OUTPUT_ASCII;
+            printf("\033[2J");
+        } else if (c == 'm' || c == 'M') {
+            render_mode = render_mode == RENDER_SDF ? RENDER_RASTER : RENDER_SDF;
+        } else if (c == 'k' || c == 'K') {
+            if (!scene_particles.count) particles_init(&scene_particles, PARTICLES_DEFAULT, scene_extent());
+            particles_enabled = !particles_enabled && scene_particles.count;
+        } else if (c == 'x' || c == 'X') {
+            oit_enabled = !oit_enabled;
+        } else if (c == 'p' || c == 'P') {
+            post_enabled = !post_enabled;
+        } else if (c == 's' || c == 'S') {
+            ssaa_set(ssaa == 1 ? 2 : (ssaa == 2 ? 4 : 1));
+        }
+    }
+    return 1;
+}
+
+static void bench_reset(void) {
+    time_global = 0;
+    rot_x = 0.7; rot_y = 0.9; rot_z = 0.3;
+}
+
+/* One 60 Hz frame of the spinning scene; frame_stats then describe it. */
+static void bench_step(void) {
+    double dt = 1.0 / 60.0;
+    time_global += dt;
+    rot_x += 0.6 * dt;
+    rot_y += 0.8 * dt;
+    rot_z += 0.4 * dt;
+    render_frame();
+}
+
+static double bench_frames(int frames) {
+    double t0 = now_sec();
+    for (int i = 0; i < frames; i++) bench_step();
+    return (now_sec() - t0) * 1000.0 / frames;
+}
+
+static void bench_raster(int frames) {
+    static const double zooms[] = {0.3, 0.6, 1.5, 3.0, 5.0};
+    int saved_mode = raster_mode;
+    double saved_zoom = zoom;
+    printf("raster (ms/frame, %dx%d cells, %d frames)\n", buf.width, buf.height, frames);
+    printf("%6s %10s %10s\n", "zoom", "bbox", "span");
+    for (size_t i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+        zoom = zooms[i];
+        bench_reset(); raster_mode = RASTER_BBOX;
+        double t_bbox = bench_frames(frames);
+        bench_reset(); raster_mode = RASTER_SPAN;
+        double t_span = bench_frames(frames);
+        printf("%6.2f %10.4f %10.4f\n", zoom, t_bbox, t_span);
+    }
+    raster_mode = saved_mode;
+    zoom = saved_zoom;
+}
+
+static void bench_aa(int frames) {
+    int saved_mode = aa_mode, saved_raster = raster_mode;
+    printf("anti-aliasing (ms/frame, zoom %.2f)\n", zoom);
+    printf("%6s %10s %10s\n", "raster", "none", "edge");
+    for (int r = RASTER_BBOX; r <= RASTER_SPAN; r++) {
+        raster_mode = r;
+        bench_reset(); aa_mode = AA_NONE;
+        double t_none = bench_frames(frames);
+        bench_reset(); aa_mode = AA_EDGE;
+        double t_edge = bench_frames(frames);
+        printf("%6s %10.4f %10.4f\n", r == RASTER_SPAN ? "span" : "bbox", t_none, t_edge);
+    }
+    aa_mode = saved_mode;
+    raster_mode = saved_raster;
+}
+
+static void bench_shade(int frames) {
+    int saved_mode = shade_mode, saved_raster = raster_mode;
+    printf("shading (ms/frame, zoom %.2f)\n", zoom);
+    printf("%6s %10s %10s\n", "raster", "flat", "gouraud");
+    for (int r = RASTER_BBOX; r <= RASTER_SPAN; r++) {
+        raster_mode = r;
+        bench_reset(); shade_mode = SHADE_FLAT;
+        double t_flat = bench_frames(frames);
+        bench_reset(); shade_mode = SHADE_GOURAUD;
+        double t_smooth = bench_frames(frames);
+        printf("%6s %10.4f %10.4f\n", r == RASTER_SPAN ? "span" : "bbox", t_flat, t_smooth);
+    }
+    shade_mode = saved_mode;
+    raster_mode = saved_raster;
+}
+
+/* Frames with and without the shadow map, and the caster pass alone; then
+ * the depth-only span kernel against the colour one and a plain clear, in
+ * samples per second over whole rows. */
+static void bench_shadow(int frames) {
+    static const double zooms[] = {0.6, 1.5, 3.0};
+    if (shadow_begin(v3(0, 0, -view_dist), 2.0) < 0) return;
+    int saved = shadow_enabled;
+    double saved_zoom = zoom;
+    printf("shadows (ms/frame, %dx%d map)\n", shadow.size, shadow.size);
+    printf("%6s %10s %10s %10s\n", "zoom", "off", "on", "pass");
+    for (size_t i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+        zoom = zooms[i];
+        bench_reset(); shadow_enabled = 0;
+        double t_off = bench_frames(frames);
+        bench_reset(); shadow_enabled = 1;
+        double t_on = bench_frames(frames);
+        bench_reset();
+        double t0 = now_sec();
+        for (int f = 0; f < frames; f++) {
+            time_global += 1.0 / 60.0;
+            lights_update();
+            shadow_pass();
+        }
+        printf("%6.2f %10.4f %10.4f %10.4f\n", zoom, t_off, t_on, (now_sec() - t0) * 1000.0 / frames);
+    }
+    shadow_enabled = saved;
+    zoom = saved_zoom;
+
+    int size = shadow.size, rows = buf.height * 2;
+    double t0 = now_sec();
+    for (int f = 0; f < frames; f++) shadow_begin(v3(0, 0, -view_dist), 2.0);
+    double t_clear = now_sec() - t0;
+    t0 = now_sec();
+    for (int f = 0; f < frames; f++)
+        for (int y = 0; y < size; y++)
+            fill_depth(shadow.depth + (size_t)y * (size_t)size, 0, size - 1, (float)f, 1e-4f);
+    double t_depth = now_sec() - t0;
+    t0 = now_sec();
+    for (int f = 0; f < frames; f++)
+        for (int y = 0; y < rows; y++) {
+            Color *col; double *depth; double bias;
+            sample_row(y, &col, &depth, &bias);
+            fill_span(col, depth, 0, buf.width - 1, (double)f, 1e-4, bias, rgb(200, 100, 50));
+        }
+    double t_color = now_sec() - t0;
+    double map_samples = (double)size * size * frames, buf_samples = (double)buf.width * rows * frames;
+    printf("%10s %10s %10s (Msamples/s)\n", "clear", "depth", "colour");
+    printf("%10.0f %10.0f %10.0f\n", map_samples / t_clear / 1e6, map_samples / t_depth / 1e6,
+           buf_samples / t_color / 1e6);
+}
+
+/* Flat fill against perspective-correct textured fill as the model grows on
+ * screen. Without --texture a procedural checker stands in. */
+static void bench_texture(int frames) {
+    static const double zooms[] = {0.3, 0.6, 1.5, 3.0};
+    int own = !num_textures, had_uv = scene_mesh.uv != NULL;
+    if (own && texture_checker(&textures[0], 256) < 0) return;
+    if (own) num_textures = 1;
+    if (!had_uv && (mesh_box_uv(&scene_mesh) < 0 || lod_box_uv(&scene_lod) < 0)) {
+        if (own) textures_free();
+        return;
+    }
+    int saved = texture_enabled, saved_raster = raster_mode;
+    double saved_zoom = zoom;
+    printf("texture (ms/frame, %dx%d texels, %d levels)\n", textures[0].size, textures[0].size,
+           textures[0].levels);
+    printf("%6s %10s %10s %10s\n", "zoom", "flat", "tex bbox", "tex span");
+    for (size_t i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+        zoom = zooms[i];
+        raster_mode = RASTER_SPAN;
+        bench_reset(); texture_enabled = 0;
+        double t_flat = bench_frames(frames);
+        texture_enabled = 1;
+        raster_mode = RASTER_BBOX;
+        bench_reset();
+        double t_bbox = bench_frames(frames);
+        raster_mode = RASTER_SPAN;
+        bench_reset();
+        double t_span = bench_frames(frames);
+        printf("%6.2f %10.4f %10.4f %10.4f\n", zoom, t_flat, t_bbox, t_span);
+    }
+    texture_enabled = saved;
+    raster_mode = saved_raster;
+    zoom = saved_zoom;
+    if (!had_uv) {
+        Mesh *meshes[LOD_MAX] = {&scene_mesh};
+        for (int l = 1; l < scene_lod.count; l++) meshes[l] = &scene_lod.own[l];
+        for (int l = 0; l < scene_lod.count; l++) {
+            free(meshes[l]->uv);
+            free(meshes[l]->tex);
+            meshes[l]->uv = NULL;
+            meshes[l]->tex = NULL;
+        }
+    }
+    if (own) textures_free();
+}
+
+/* shade() alone over a block of random colours, then Gouraud frames (a
+ * shade per sample) in both spaces. */
+static void bench_light_space(int frames) {
+    int n = 1 << 16, reps = frames / 10 > 0 ? frames / 10 : 1;
+    Color *in = malloc((size_t)n * sizeof(Color)), *out = malloc((size_t)n * sizeof(Color));
+    float *b = malloc((size_t)n * sizeof(float));
+    srand(3);
+    for (int i = 0; i < n; i++) {
+        in[i] = rgb((uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand());
+        b[i] = (float)rand() / (float)RAND_MAX;
+    }
+    int saved = light_space, saved_shade = shade_mode;
+    double ns[2], ms[2];
+    unsigned sink = 0;
+    for (int mode = LIGHT_SRGB; mode <= LIGHT_LINEAR; mode++) {
+        light_space_set(mode);
+        double t0 = now_sec();
+        for (int r = 0; r < reps; r++)
+            for (int i = 0; i < n; i++) out[i] = shade(in[i], b[i]);
+        ns[mode] = (now_sec() - t0) * 1e9 / ((double)reps * n);
+        for (int i = 0; i < n; i += 97) sink += out[i].r;
+        shade_mode = SHADE_GOURAUD;
+        bench_reset();
+        ms[mode] = bench_frames(frames);
+    }
+    light_space_set(saved);
+    shade_mode = saved_shade;
+    printf("shading space (shade() ns/call, gouraud ms/frame; checksum %u)\n", sink & 0xFF);
+    printf("%6s %10s %10s\n", "space", "ns", "ms");
+    printf("%6s %10.3f %10.4f\n", "srgb", ns[LIGHT_SRGB], ms[LIGHT_SRGB]);
+    printf("%6s %10.3f %10.4f\n", "linear", ns[LIGHT_LINEAR], ms[LIGHT_LINEAR]);
+    free(in);
+    free(out);
+    free(b);
+}
+
+/* Opaque frames against translucent ones as the view zooms in and the
+ * layers grow: accumulated fragments per frame, the distinct samples they
+ * covered (their ratio is the average overlap) and the cost per fragment. */
+static void bench_oit(int frames) {
+    static const double zooms[] = {0.6, 1.5, 3.0};
+    if (scene_voxels.n) return;
+    int saved = oit_enabled;
+    double saved_zoom = zoom;
+    printf("translucency (ms/frame, alpha %.2f%s)\n", translucent_alpha,
+           scene_instances.count ? ", alternate instances" : "");
+    printf("%6s %10s %10s %10s %10s %10s\n", "zoom", "opaque", "oit", "frags", "layers", "ns/frag");
+    for (size_t i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+        zoom = zooms[i];
+        bench_reset(); oit_enabled = 0;
+        double t_off = bench_frames(frames);
+        bench_reset(); oit_enabled = 1;
+        double frags = 0, samples = 0, t0 = now_sec();
+        for (int f = 0; f < frames; f++) {
+            bench_step();
+            frags += (double)frame_stats.oit_frags;
+            samples += (double)frame_stats.oit_samples;
+        }
+        double t_on = (now_sec() - t0) * 1000.0 / frames;
+        printf("%6.2f %10.4f %10.4f %10.0f %10.2f %10.2f\n", zoom, t_off, t_on, frags / frames,
+               samples > 0 ? frags / samples : 0.0, frags > 0 ? (t_on - t_off) * 1e6 * frames / frags : 0.0);
+    }
+    oit_enabled = saved;
+    zoom = saved_zoom;
+}
+
+/* Particle update and splat alone for growing counts, one update thread
+ * against one per core, then whole frames with the sparks on. The splat
+ * goes into a rendered frame so the depth test sees the scene. */
+static void bench_particles(int frames) {
+    static const int counts[] = {1 << 15, 1 << 17, 1 << 20};
+    int workers = num_workers(), reps = frames / 4 > 0 ? frames / 4 : 1;
+    int saved = particles_enabled;
+    Particles saved_ps = scene_particles;
+    float dt = 1.0f / 60.0f;
+    printf("particles (ms/frame, %d update threads)\n", workers);
+    printf("%8s %10s %10s %10s %10s %10s\n", "count", "update", "parallel", "splat", "frame", "Mpart/s");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        Particles ps;
+        if (particles_init(&ps, counts[c], scene_extent()) < 0) continue;
+        double t0 = now_sec();
+        for (int f = 0; f < reps; f++) particles_update(&ps, dt, 1);
+        double t_up = (now_sec() - t0) * 1000.0 / reps;
+        t0 = now_sec();
+        for (int f = 0; f < reps; f++) particles_update(&ps, dt, workers);
+        double t_par = (now_sec() - t0) * 1000.0 / reps;
+        bench_reset();
+        render_frame();
+        t0 = now_sec();
+        for (int f = 0; f < reps; f++) particles_splat(&ps);
+        double t_splat = (now_sec() - t0) * 1000.0 / reps;
+        scene_particles = ps;
+        particles_enabled = 1;
+        bench_reset();
+        scene_particles.last = time_global;
+        double t_frame = bench_frames(reps);
+        printf("%8d %10.4f %10.4f %10.4f %10.4f %10.1f\n", counts[c], t_up, t_par, t_splat, t_frame,
+               counts[c] / (t_up + t_splat) / 1e3);
+        particles_free(&scene_particles);
+    }
+    scene_particles = saved_ps;
+    particles_enabled = saved;
+}
+
+/* Rasterizing the scene against raymarching the SDF one, per frame and per
+ * sample of the frame, as the object grows on screen: single-threaded and
+ * across sdf_threads, with the average field evaluations per marched ray. */
+static void bench_sdf(int frames) {
+    static const double zooms[] = {0.6, 1.5, 3.0};
+    int saved_mode = render_mode, saved_threads = sdf_threads;
+    double saved_zoom = zoom, samples = (double)buf.width * buf.height * 2 * ssaa * ssaa;
+    printf("sdf raymarching (ms/frame, ns per frame sample)\n");
+    printf("%6s %10s %10s %10s %10s %10s %10s\n", "zoom", "raster", "sdf", "sdf mt", "steps/ray", "raster ns", "sdf ns");
+    for (size_t i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+        zoom = zooms[i];
+        render_mode = RENDER_RASTER;
+        bench_reset();
+        double t_raster = bench_frames(frames);
+        render_mode = RENDER_SDF;
+        sdf_threads = 1;
+        bench_reset();
+        double rays = 0, steps = 0, t0 = now_sec();
+        for (int f = 0; f < frames; f++) {
+            bench_step();
+            rays += (double)frame_stats.sdf_rays;
+            steps += (double)frame_stats.sdf_steps;
+        }
+        double t_sdf = (now_sec() - t0) * 1000.0 / frames;
+        sdf_threads = saved_threads;
+        bench_reset();
+        double t_mt = bench_frames(frames);
+        printf("%6.2f %10.4f %10.4f %10.4f %10.2f %10.2f %10.2f\n", zoom, t_raster, t_sdf, t_mt,
+               rays > 0 ? steps / rays : 0.0, t_raster * 1e6 / samples, t_sdf * 1e6 / samples);
+    }
+    render_mode = saved_mode;
+    sdf_threads = saved_threads;
+    zoom = saved_zoom;
+}
+
+/* The frame with no post-processing, each pass alone and the whole stack,
+ * at the strengths configured; a zero strength shows what a skip costs. */
+static void bench_post(int frames) {
+    int saved = post_enabled;
+    double saved_strength[POST_PASSES];
+    memcpy(saved_strength, post_strength, sizeof(saved_strength));
+    printf("post-processing (ms/frame, %dx%d samples)\n", buf.width, buf.height * 2);
+    printf("%8s %10s %10s %10s\n", "passes", "frame", "post", "Msamples/s");
+    for (int c = -1; c <= POST_PASSES; c++) {
+        for (int p = 0; p < POST_PASSES; p++)
+            post_strength[p] = c == POST_PASSES || c == p ? saved_strength[p] : 0.0;
+        post_enabled = c >= 0;
+        bench_reset();
+        double t_post = 0, t0 = now_sec();
+        for (int i = 0; i < frames; i++) {
+            bench_step();
+            if (c >= 0)
+                for (int p = 0; p < POST_PASSES; p++) t_post += frame_stats.post_ms[p];
+        }
+        double ms = (now_sec() - t0) * 1000.0 / frames;
+        t_post /= frames;
+        double samples = (double)buf.width * buf.height * 2;
+        printf("%8s %10.4f %10.4f %10.0f\n", c < 0 ? "none" : (c == POST_PASSES ? "all" : POST_NAMES[c]),
+               ms, t_post, t_post > 0 ? samples / t_post / 1e3 : 0.0);
+    }
+    memcpy(post_strength, saved_strength, sizeof(saved_strength));
+    post_enabled = saved;
+}
+
+/* buf_render() itself, truecolor against ASCII, on live frames as the cube
+ * grows to fill the screen: the output goes to a scratch file so its size
+ * per frame can be read back. */
+static void bench_output(int frames) {
+    static const double zooms[] = {0.6, 1.5, 3.0};
+    int saved = output_mode;
+    double saved_zoom = zoom;
+    printf("terminal output (%dx%d cells)\n", buf.width, buf.height);
+    printf("%6s %6s %10s %12s %10s\n", "zoom", "mode", "ms/frame", "bytes/frame", "bytes/cell");
+    fflush(stdout);
+    for (size_t z = 0; z < sizeof(zooms) / sizeof(zooms[0]); z++) {
+        zoom = zooms[z];
+        for (int m = OUTPUT_COLOR; m <= OUTPUT_ASCII; m++) {
+            FILE *f = tmpfile();
+            if (!f) break;
+            int saved_fd = dup(1);
+            dup2(fileno(f), 1);
+            output_mode = m;
+            bench_reset();
+            double t = 0;
+            for (int i = 0; i < frames; i++) {
+                bench_step();
+                double t0 = now_sec();
+                buf_render();
+                t += now_sec() - t0;
+            }
+            off_t bytes = lseek(1, 0, SEEK_END);
+            dup2(saved_fd, 1);
+            close(saved_fd);
+            fclose(f);
+            double per_frame = (double)bytes / frames;
+            printf("%6.2f %6s %10.4f %12.0f %10.2f\n", zoom, m == OUTPUT_ASCII ? "ascii" : "color",
+                   t * 1000.0 / frames, per_frame, per_frame / ((double)buf.width * buf.height));
+            fflush(stdout);
+        }
+    }
+    output_mode = saved;
+    zoom = saved_zoom;
+}
+
+static void bench_ssaa(int frames) {
+    int saved = ssaa;
+    printf("supersampling (ms/frame incl. resolve, zoom %.2f)\n", zoom);
+    printf("%6s %10s\n", "factor", "ms");
+    for (int f = 1; f <= 4; f *= 2) {
+        ssaa_set(f);
+        bench_reset();
+        printf("%6d %10.4f\n", f, bench_frames(frames));
+    }
+    ssaa_set(saved);
+}
+
+/* Float SoA kernels against the double scalar reference on a random cloud. */
+static void bench_vecmath(int frames) {
+    int n = 100000, reps = frames / 50 > 0 ? frames / 50 : 1;
+    float *x = alloc_aligned((size_t)n * sizeof(float) * 8);
+    float *y = x + n, *z = y + n, *ox = z + n, *oy = ox + n, *oz = oy + n;
+    float *sx = oz + n, *sy = sx + n;
+    Vec3 *ref = malloc((size_t)n * sizeof(Vec3));
+    srand(1);
+    for (int i = 0; i < n; i++) {
+        x[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        y[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        z[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+    }
+    Mat4 mv = mat4_mul(mat4_translate(0, 0, -5.0), mat4_euler(rot_x, rot_y, rot_z));
+    Mat4f mvf = mat4f_from(&mv);
+
+    double t0 = now_sec();
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < n; i++) {
+            Vec3 v = mat4_point(&mv, v3(x[i], y[i], z[i]));
+            Vec3 sc = clip_to_screen(to_clip(v));
+            ref[i] = v3(sc.x, sc.y, length(normalize(v)));
+        }
+    }
+    double t_ref = (now_sec() - t0) * 1000.0 / reps;
+
+    t0 = now_sec();
+    for (int r = 0; r < reps; r++) {
+        soa_transform_points(&mvf, x, y, z, ox, oy, oz, n);
+        soa_project(ox, oy, oz, sx, sy, n);
+        soa_normalize(ox, oy, oz, n);
+    }
+    double t_soa = (now_sec() - t0) * 1000.0 / reps;
+
+    double err = 0;
+    for (int i = 0; i < n; i++) {
+        err = fmax(err, fabs(sx[i] - ref[i].x));
+        err = fmax(err, fabs(sy[i] - ref[i].y));
+    }
+    printf("vecmath (%d verts: transform + project + normalize)\n", n);
+    printf("%10s %10s %12s\n", "double ms", "soa ms", "max err px");
+    printf("%10.4f %10.4f %12.6f\n", t_ref, t_soa, err);
+    free(ref);
+    free(x);
+}
+
+/* Batched shading against the per-face scalar reference, then the extra
+ * cost of four point lights. Each path runs once untimed first, so the
+ * output pages are faulted in before the clock starts, then at least
+ * LIGHT_BENCH_REPS times. */
+#define LIGHT_BENCH_REPS 10
+
+static void bench_light(int frames) {
+    int n = 100000, reps = frames / 50 > LIGHT_BENCH_REPS ? frames / 50 : LIGHT_BENCH_REPS;
+    float *nx = alloc_aligned((size_t)n * sizeof(float) * 8);
+    float *ny = nx + n, *nz = ny + n, *px = nz + n, *py = px + n, *pz = py + n;
+    float *out = pz + n, *ref = out + n;
+    srand(2);
+    for (int i = 0; i < n; i++) {
+        Vec3 v = normalize(v3(rand() / (double)RAND_MAX - 0.5, rand() / (double)RAND_MAX - 0.5,
+                              rand() / (double)RAND_MAX - 0.5));
+        nx[i] = (float)v.x; ny[i] = (float)v.y; nz[i] = (float)v.z;
+        px[i] = (float)(rand() / (double)RAND_MAX * 2.0 - 1.0);
+        py[i] = (float)(rand() / (double)RAND_MAX * 2.0 - 1.0);
+        pz[i] = (float)(rand() / (double)RAND_MAX * 2.0 - 1.0 - view_dist);
+    }
+    int saved = num_point_lights;
+    bench_reset();
+    time_global = 1.0;
+
+    for (int i = 0; i < n; i++) ref[i] = (float)calc_light(v3(nx[i], ny[i], nz[i]));
+    double t0 = now_sec();
+    for (int r = 0; r < reps; r++)
+        for (int i = 0; i < n; i++) ref[i] = (float)calc_light(v3(nx[i], ny[i], nz[i]));
+    double t_ref = (now_sec() - t0) * 1000.0 / reps;
+
+    num_point_lights = 0;
+    lights_update();
+    soa_light(nx, ny, nz, px, py, pz, out, NULL, n);
+    t0 = now_sec();
+    for (int r = 0; r < reps; r++) {
+        lights_update();
+        soa_light(nx, ny, nz, px, py, pz, out, NULL, n);
+    }
+    double t_batch = (now_sec() - t0) * 1000.0 / reps;
+    double err = 0;
+    for (int i = 0; i < n; i++) err = fmax(err, fabsf(out[i] - ref[i]));
+
+    num_point_lights = 4;
+    lights_update();
+    soa_light(nx, ny, nz, px, py, pz, out, NULL, n);
+    t0 = now_sec();
+    for (int r = 0; r < reps; r++) {
+        lights_update();
+        soa_light(nx, ny, nz, px, py, pz, out, NULL, n);
+    }
+    double t_point = (now_sec() - t0) * 1000.0 / reps;
+    num_point_lights = saved;
+
+    printf("lighting (%d faces)\n", n);
+    printf("%10s %10s %12s %10s\n", "scalar ms", "batch ms", "+4 point ms", "max err");
+    printf("%10.4f %10.4f %12.4f %10.6f\n", t_ref, t_batch, t_point - t_batch, err);
+    free(nx);
+}
+
+/* Throughput of the scene as configured (cube, model or lattice). */
+static void bench_scene(int frames) {
+    bench_reset();
+    long tris = 0, drawn = 0, inst = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < frames; i++) {
+        bench_step();
+        tris += frame_stats.tris;
+        drawn += frame_stats.tris_drawn;
+        inst += frame_stats.instances;
+    }
+    double secs = now_sec() - t0;
+    printf("scene (per frame averages, zoom %.2f)\n", zoom);
+    printf("%10s %12s %12s %10s %12s\n", "instances", "tris", "tris drawn", "ms", "Mtris/s");
+    printf("%10.0f %12.0f %12.0f %10.4f %12.2f\n",
+           (double)inst / frames, (double)tris / frames, (double)drawn / frames,
+           secs * 1000.0 / frames, (double)tris / secs / 1e6);
+}
+
+/* Culling alone, linear sweep against BVH, as the view zooms in and more
+ * of the scene falls outside the frustum. */
+static void bench_cull(int frames) {
+    static const double zooms[] = {0.6, 1.5, 3.0, 5.0};
+    Instances *in = &scene_instances;
+    if (!in->count) return;
+    int saved_mode = cull_mode;
+    double saved_zoom = zoom;
+    int reps = frames * 4;
+    bench_reset();
+    Mat4 view = mat4_mul(mat4_translate(0, 0, -view_dist), mat4_euler(rot_x, rot_y, rot_z));
+    printf("culling (%d instances, us per cull)\n", in->count);
+    printf("%6s %10s %10s %10s\n", "zoom", "visible", "linear", "bvh");
+    for (size_t z = 0; z < sizeof(zooms) / sizeof(zooms[0]); z++) {
+        zoom = zooms[z];
+        double t[2];
+        int vis = 0;
+        for (int mode = CULL_LINEAR; mode <= CULL_BVH; mode++) {
+            cull_mode = mode;
+            double t0 = now_sec();
+            for (int r = 0; r < reps; r++) vis = cull_instances(in, &scene_bvh, &view);
+            t[mode] = (now_sec() - t0) * 1e6 / reps;
+        }
+        printf("%6.2f %10d %10.2f %10.2f\n", zoom, vis, t[CULL_LINEAR], t[CULL_BVH]);
+    }
+    cull_mode = saved_mode;
+    zoom = saved_zoom;
+}
+
+/* Whole frames with and without level of detail while the model shrinks on
+ * screen: with LOD the triangle count should follow the covered area. */
+static void bench_lod(int frames) {
+    static const double zooms[] = {2.0, 1.0, 0.5, 0.25, 0.1};
+    if (scene_lod.count < 2) return;
+    int saved = lod_enabled;
+    double saved_zoom = zoom;
+    printf("level of detail (tris drawn per frame, ms)\n");
+    printf("%6s %12s %10s %12s %10s\n", "zoom", "full tris", "full ms", "lod tris", "lod ms");
+    for (size_t z = 0; z < sizeof(zooms) / sizeof(zooms[0]); z++) {
+        zoom = zooms[z];
+        double ms[2];
+        long drawn[2];
+        for (int on = 0; on < 2; on++) {
+            lod_enabled = on;
+            bench_reset();
+            drawn[on] = 0;
+            double t0 = now_sec();
+            for (int i = 0; i < frames; i++) {
+                render_frame();
+                drawn[on] += frame_stats.tris_drawn;
+            }
+            ms[on] = (now_sec() - t0) * 1000.0 / frames;
+        }
+        printf("%6.2f %12ld %10.3f %12ld %10.3f\n", zoom, drawn[0] / frames, ms[0],
+               drawn[1] / frames, ms[1]);
+    }
+    lod_enabled = saved;
+    zoom = saved_zoom;
+}
+
+/* Greedy quads against one quad per exposed face and one cube per voxel,
+ * then a full re-mesh against the per-frame incremental one. */
+static void bench_voxels(int frames) {
+    VoxelGrid *g = &scene_voxels;
+    if (!g->n) return;
+    long solid = 0, faces = 0, tris = 0;
+    for (int z = 0; z < g->n; z++)
+        for (int y = 0; y < g->n; y++)
+            for (int wx = 0; wx < g->nc; wx++) {
+                solid += __builtin_popcount(voxel_row(g, wx, y, z));
+                for (int dir = 0; dir < 6; dir++)
+                    faces += __builtin_popcount(voxel_faces(g, dir, wx, y, z));
+            }
+    int count = g->nc * g->nc * g->nc;
+    memset(g->dirty, 1, (size_t)count);
+    double t0 = now_sec();
+    voxels_remesh(g);
+    double t_full = (now_sec() - t0) * 1000.0;
+    for (int i = 0; i < count; i++) tris += g->chunks[i].num_tris;
+
+    bench_reset();
+    long chunks = 0, edits = 0;
+    double t_edit = 0;
+    for (int i = 0; i < frames; i++) {
+        time_global += 1.0 / 60.0;
+        t0 = now_sec();
+        voxels_animate(g);
+        int r = voxels_remesh(g);
+        t_edit += now_sec() - t0;
+        chunks += r;
+        edits += r > 0;
+    }
+    printf("voxels (%d^3, %ld solid, %d chunks)\n", g->n, solid, count);
+    printf("%12s %12s %12s %12s\n", "cube tris", "face tris", "greedy tris", "full ms");
+    printf("%12ld %12ld %12ld %12.3f\n", solid * 12, faces * 2, tris, t_full);
+    printf("%12s %12s %12s\n", "edits", "chunks/edit", "ms/edit");
+    printf("%12ld %12.2f %12.4f\n", edits, edits ? (double)chunks / (double)edits : 0.0,
+           edits ? t_edit * 1000.0 / (double)edits : 0.0);
+}
+
+static void run_bench(int frames) {
+    bench_scene(frames);
+    bench_voxels(frames);
+    bench_cull(frames);
+    bench_lod(frames);
+    bench_raster(frames);
+    bench_aa(frames);
+    bench_shade(frames);
+    bench_light_space(frames);
+    bench_texture(frames);
+    bench_shadow(frames);
+    bench_oit(frames);
+    bench_particles(frames);
+    bench_sdf(frames);
+    bench_post(frames);
+    bench_output(frames);
+    bench_ssaa(frames);
+    bench_vecmath(frames);
+    bench_light(frames);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [--raster bbox|span] [--aa none|edge] [--ssaa 1|2|4] [--no-outline]\n"
+        "       [--shade flat|gouraud] [--shade-space srgb|linear] [--texture file.ppm|file.png]... [--shadows N]\n"
+        "       [--post] [--glow S] [--bloom S] [--vignette S] [--translucent A]\n"
+        "       [--particles N] [--particle-threads N] [--render raster|sdf] [--sdf-threads N]\n"
+        "       [--ascii]\n"
+        "       [--model file.obj|file.ply|file.mesh] [--lattice N] [--wave]\n"
+        "       [--cull bvh|linear] [--no-lod] [--voxels N] [--lights N]\n"
+        "       [--bench [frames]] [--size WxH]\n"
+        "       %s --bake model.obj|model.ply out.mesh\n", prog, prog);
+}
+
+/* Frees everything main sets up; parts never allocated are already empty. */
+static void teardown(void) {
+    particles_free(&scene_particles);
+    voxels_free(&scene_voxels);
+    bvh_free(&scene_bvh);
+    instances_free(&scene_instances);
+    shadow_free();
+    oit_free();
+    post_free();
+    textures_free();
+    lod_free(&scene_lod);
+    mesh_free(&scene_mesh);
+    ssaa_set(1);
+    buf_free();
+}
+
+int main(int argc, char **argv) {
+    int w, h;
+    int bench = 0, bench_n = 500;
+    int size_w = 0, size_h = 0;
+    const char *model = NULL;
+    int lattice = 0, wave = 0, voxels = 0, particles = 0;
+    const char *bake_in = NULL, *bake_out = NULL;
+    const char *tex_files[MAX_TEXTURES];
+    int num_tex_files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--raster") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "span")) raster_mode = RASTER_SPAN;
+            else if (!strcmp(m, "bbox")) raster_mode = RASTER_BBOX;
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--aa") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "edge")) aa_mode = AA_EDGE;
+            else if (!strcmp(m, "none")) aa_mode = AA_NONE;
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--shade") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "gouraud")) shade_mode = SHADE_GOURAUD;
+            else if (!strcmp(m, "flat")) shade_mode = SHADE_FLAT;
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--shade-space") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "linear")) light_space_set(LIGHT_LINEAR);
+            else if (!strcmp(m, "srgb")) light_space_set(LIGHT_SRGB);
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--shadows") && i + 1 < argc) {
+            shadow.size = atoi(argv[++i]);
+            if (shadow.size < 16 || shadow.size > SHADOW_MAX) { usage(argv[0]); return 1; }
+            shadow_enabled = 1;
+        } else if (!strcmp(argv[i], "--translucent") && i + 1 < argc) {
+            translucent_alpha = atof(argv[++i]);
+            if (!(translucent_alpha > 0 && translucent_alpha < 1)) { usage(argv[0]); return 1; }
+            oit_enabled = 1;
+        } else if (!strcmp(argv[i], "--particles") && i + 1 < argc) {
+            particles = atoi(argv[++i]);
+            if (particles < 1 || particles > MAX_PARTICLES) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--particle-threads") && i + 1 < argc) {
+            particle_threads = atoi(argv[++i]);
+            if (particle_threads < 0 || particle_threads > 16) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--render") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "sdf")) render_mode = RENDER_SDF;
+            else if (!strcmp(m, "raster")) render_mode = RENDER_RASTER;
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--sdf-threads") && i + 1 < argc) {
+            sdf_threads = atoi(argv[++i]);
+            if (sdf_threads < 0 || sdf_threads > 16) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--ascii")) {
+            output_mode = OUTPUT_ASCII;
+        } else if (!strcmp(argv[i], "--post")) {
+            post_enabled = 1;
+        } else if ((!strcmp(argv[i], "--glow") || !strcmp(argv[i], "--bloom") ||
+                    !strcmp(argv[i], "--vignette")) && i + 1 < argc) {
+            int p = argv[i][2] == 'g' ? POST_GLOW : (argv[i][2] == 'b' ? POST_BLOOM : POST_VIGNETTE);
+            post_strength[p] = atof(argv[++i]);
+            if (!(post_strength[p] >= 0 && post_strength[p] <= POST_MAX_STRENGTH)) { usage(argv[0]); return 1; }
+            post_enabled = 1;
+        } else if (!strcmp(argv[i], "--texture") && i + 1 < argc) {
+            if (num_tex_files == MAX_TEXTURES) { usage(argv[0]); return 1; }
+            tex_files[num_tex_files++] = argv[++i];
+        } else if (!strcmp(argv[i], "--ssaa") && i + 1 < argc) {
+            ssaa = atoi(argv[++i]);
+            if (ssaa != 1 && ssaa != 2 && ssaa != 4) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--no-outline")) {
+            draw_outline = 0;
+        } else if (!strcmp(argv[i], "--bake") && i + 2 < argc) {
+            bake_in = argv[++i];
+            bake_out = argv[++i];
+        } else if (!strcmp(argv[i], "--lattice") && i + 1 < argc) {
+            lattice = atoi(argv[++i]);
+            if (lattice < 1 || lattice > 64) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--voxels") && i + 1 < argc) {
+            voxels = atoi(argv[++i]);
+            if (voxels < VOXEL_CHUNK || voxels > 256 || voxels % VOXEL_CHUNK) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+            num_point_lights = atoi(argv[++i]);
+            if (num_point_lights < 0 || num_point_lights > MAX_LIGHTS) { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--no-lod")) {
+            lod_enabled = 0;
+        } else if (!strcmp(argv[i], "--wave")) {
+            wave = 1;
+        } else if (!strcmp(argv[i], "--cull") && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "bvh")) cull_mode = CULL_BVH;
+            else if (!strcmp(m, "linear")) cull_mode = CULL_LINEAR;
+            else { usage(argv[0]); return 1; }
+        } else if (!strcmp(argv[i], "--model") && i + 1 < argc) {
+            model = argv[++i];
+        } else if (!strcmp(argv[i], "--bench")) {
+            bench = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') bench_n = atoi(argv[++i]);
+            if (bench_n < 1) bench_n = 1;
+        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &size_w, &size_h) != 2 ||
+                size_w < 1 || size_h < 1 || size_w > MAX_WIDTH || size_h > MAX_HEIGHT) {
+                usage(argv[0]); return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (bake_in) {
+        Mesh m;
+        LodChain lod;
+        double t0 = now_sec();
+        if (mesh_load(bake_in, &m, &lod) < 0) {
+            fprintf(stderr, "%s: cannot load model '%s'\n", argv[0], bake_in);
+            return 1;
+        }
+        double t1 = now_sec();
+        lod_ensure(&lod);
+        double t2 = now_sec();
+        int r = mesh_save(&lod, bake_out);
+        if (r < 0) fprintf(stderr, "%s: cannot write '%s'\n", argv[0], bake_out);
+        else printf("%s: %d verts, %d tris, %d edges, %d lod levels "
+                    "(parsed in %.2f ms, simplified in %.2f ms, written in %.2f ms)\n",
+                    bake_out, m.num_verts, m.num_tris, m.num_edges, lod.count,
+                    (t1 - t0) * 1000.0, (t2 - t1) * 1000.0, (now_sec() - t2) * 1000.0);
+        lod_free(&lod);
+        mesh_free(&m);
+        return r < 0 ? 1 : 0;
+    }
+
+    if (voxels && (model || lattice)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (size_w > 0) { w = size_w; h = size_h; }
+    else if (bench) { w = 200; h = 60; }
+    else get_term_size(&w, &h);
+    buf_init(w, h);
+    ssaa_set(ssaa);
+
+    double t_load = now_sec();
+    if (model) {
+        if (mesh_load(model, &scene_mesh, &scene_lod) < 0) {
+            fprintf(stderr, "%s: cannot load model '%s'\n", argv[0], model);
+            teardown();
+            return 1;
+        }
+    } else {
+        if (mesh_init_cube(&scene_mesh) < 0) {
+            fprintf(stderr, "%s: cannot allocate the cube\n", argv[0]);
+            teardown();
+            return 1;
+        }
+        lod_init(&scene_lod, &scene_mesh);
+    }
+    t_load = now_sec() - t_load;
+    int lod_baked = scene_lod.built;
+    for (int t = 0; t < num_tex_files; t++) {
+        if (texture_load(tex_files[t], &textures[t]) < 0) {
+            fprintf(stderr, "%s: cannot load texture '%s'\n", argv[0], tex_files[t]);
+            teardown();
+            return 1;
+        }
+        num_textures++;
+    }
+    if (num_textures && (mesh_box_uv(&scene_mesh) < 0 || lod_box_uv(&scene_lod) < 0)) {
+        fprintf(stderr, "%s: cannot allocate texture coordinates\n", argv[0]);
+        teardown();
+        return 1;
+    }
+    double t_lod = now_sec();
+    if (lod_enabled) lod_ensure(&scene_lod);
+    t_lod = now_sec() - t_lod;
+    if (lattice) {
+        if (instances_init_lattice(&scene_instances, lattice) < 0 ||
+            bvh_build(&scene_bvh, &scene_instances) < 0) {
+            fprintf(stderr, "%s: cannot allocate a %d^3 lattice\n", argv[0], lattice);
+            teardown();
+            return 1;
+        }
+        scene_instances.moving = wave;
+    }
+    double t_vox = now_sec();
+    if (voxels) {
+        if (voxels_init(&scene_voxels, voxels) < 0) {
+            fprintf(stderr, "%s: cannot allocate %d^3 voxels\n", argv[0], voxels);
+            teardown();
+            return 1;
+        }
+        voxels_init_terrain(&scene_voxels);
+        voxels_remesh(&scene_voxels);
+    }
+    t_vox = now_sec() - t_vox;
+    if (particles) {
+        if (particles_init(&scene_particles, particles, scene_extent()) < 0) {
+            fprintf(stderr, "%s: cannot allocate %d particles\n", argv[0], particles);
+            teardown();
+            return 1;
+        }
+        particles_enabled = 1;
+    }
+
+    if (bench) {
+        printf("model: %d verts, %d tris, %d edges, loaded in %.2f ms\n",
+               scene_mesh.num_verts, scene_mesh.num_tris, scene_mesh.num_edges, t_load * 1000.0);
+        if (scene_lod.count > 1) {
+            printf("lod: %d levels (", scene_lod.count);
+            for (int l = 0; l < scene_lod.count; l++)
+                printf("%s%d", l ? " " : "", scene_lod.level[l]->num_tris);
+            if (lod_baked) printf(" tris), baked\n");
+            else printf(" tris), built in %.2f ms\n", t_lod * 1000.0);
+        }
+        if (voxels) printf("voxels: %d^3, generated and meshed in %.2f ms\n", voxels, t_vox * 1000.0);
+        run_bench(bench_n);
+        teardown();
+        return 0;
+    }
+
+    term_init();
+    
+    struct timeval last_time;
+    gettimeofday(&last_time, NULL);
+    
+    while (1) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        
+        double dt = (now.tv_sec - last_time.tv_sec) +
+                   (now.tv_usec - last_time.tv_usec) / 1e6;
+        last_time = now;
+        
+        if (dt > 0.1) dt = 0.1;
+        time_global += dt;
+        rot_x += 0.6 * dt;
+        rot_y += 0.8 * dt;
+        rot_z += 0.4 * dt;
+        
+        if (!handle_input()) break;
+        render_frame();
+        buf_render();
+        usleep(16667);
+    }
+    
+    term_cleanup();
+    teardown();
     return 0;
 }
\ No newline at end of file